@@ -0,0 +1,492 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "libmem.h"
+
+#define WINDOW 4096 // live blocks of the churn workloads
+#define BURST 65536 // blocks allocated before a burst is freed
+#define LONG_LIVED 16384 // blocks kept through a whole long-lived run
+#define SMALL_BLOCKS (1 << 20) // blocks live at once in the small workload
+#define RING 1024 // slots between producer and consumer
+#define RSS_EVERY 4096 // operations between resident size samples
+#define BUCKETS 512 // latency histogram, see bucket_of
+
+/*
+ * bench runs standard allocator workloads against libmem, under each of
+ * its placement policies and with the buddy engine, and against the
+ * system malloc:
+ *   uniform    a window of live blocks of 1 to 256 bytes, replacing a
+ *              random one per step
+ *   powerlaw   the same with sizes of 8 bytes to 64KB, every doubling
+ *              half as likely as the one before
+ *   prodcons   one thread allocates, another one frees (libmem runs it
+ *              in multithreaded mode)
+ *   burst      allocate BURST blocks, then free them in random order
+ *   longlived  LONG_LIVED blocks that stay while a window churns
+ *   small      allocate SMALL_BLOCKS blocks of 1 to 64 bytes, then free
+ *              them, so peak and fragmentation show the cost per object
+ * Each workload runs twice per allocator, each time in a child process of
+ * its own so it starts from a fresh heap: once for throughput, and once
+ * timing every operation for the median and 99th percentile latency,
+ * less the cost of reading the clock. Peak is the most resident memory
+ * the workload added, and fragmentation the share of it not taken by
+ * live blocks at their requested sizes. Every block is written to on
+ * each of its pages, so both allocators get charged for what they hand out.
+ *
+ * Usage: bench [operations_per_workload]
+ */
+
+struct allocator {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    int (*init)(int threaded); // return 0 if succeed
+};
+
+// state of a workload run on one thread
+struct run {
+    const struct allocator *allocator;
+    int timed; // record the latency of every operation
+    uint64_t state; // random number generator
+    long ops;
+    long limit; // operations to run
+    size_t live; // requested bytes of live blocks
+    size_t peak_live;
+    long rss; // resident pages when the run started
+    long peak_rss;
+    uint64_t latency[BUCKETS];
+};
+
+long ops_per_workload = 2000000;
+long page_size;
+long clock_overhead; // ns spent reading the clock twice
+
+// blocks of the workloads, touched before a run so they do not count as its memory
+void *blocks[BURST > WINDOW + LONG_LIVED ? BURST : WINDOW + LONG_LIVED];
+size_t sizes[sizeof(blocks) / sizeof(blocks[0])];
+void *small_blocks[SMALL_BLOCKS];
+uint8_t small_sizes[SMALL_BLOCKS];
+
+static int init_libmem(int threaded){
+    return myInitializeMemory() || (threaded && myEnableMultithreading());
+}
+
+static int init_next_fit(int threaded){
+    return init_libmem(threaded) || mySetPlacementPolicy(MEM_POLICY_NEXT_FIT);
+}
+
+static int init_best_fit(int threaded){
+    return init_libmem(threaded) || mySetPlacementPolicy(MEM_POLICY_BEST_FIT);
+}
+
+static int init_tree_fit(int threaded){
+    return init_libmem(threaded) || mySetPlacementPolicy(MEM_POLICY_TREE_FIT);
+}
+
+static int init_buddy(int threaded){
+    struct mem_config config = {MEM_ENGINE_BUDDY, 0, 0};
+    return myInitializeMemoryConfig(&config) || (threaded && myEnableMultithreading());
+}
+
+static int init_system(int threaded){
+    return 0;
+}
+
+const struct allocator allocators[] = {
+    {"libmem", myMalloc, myFree, init_libmem},
+    {"libmem-next", myMalloc, myFree, init_next_fit},
+    {"libmem-best", myMalloc, myFree, init_best_fit},
+    {"libmem-tree", myMalloc, myFree, init_tree_fit},
+    {"libmem-buddy", myMalloc, myFree, init_buddy},
+    {"malloc", malloc, free, init_system}
+};
+
+// xorshift random number generator, one state per thread
+static uint64_t next_random(uint64_t *state){
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// 1 to 256 bytes
+static size_t uniform_size(struct run *run){
+    return 1 + next_random(&run->state) % 256;
+}
+
+// 8 bytes to 64KB, a size twice as large is half as likely
+static size_t powerlaw_size(struct run *run){
+    uint64_t random = next_random(&run->state);
+    int doubling = __builtin_ctzll(random | 1ULL << 13);
+    size_t low = (size_t)8 << doubling;
+    return low + (random >> 16) % low;
+}
+
+static long now_ns(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000L + time.tv_nsec;
+}
+
+// resident pages of the process
+static long resident_pages(){
+    long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL){
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2){
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident;
+}
+
+// histogram bucket of a latency: exact up to 64ns, then 16 per doubling
+static int bucket_of(long ns){
+    if (ns < 64){
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int log = 63 - __builtin_clzl(ns);
+    int bucket = 64 + (log - 6) * 16 + (int)((ns >> (log - 4)) & 15);
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+// lowest latency falling into bucket
+static long bucket_ns(int bucket){
+    if (bucket < 64){
+        return bucket;
+    }
+    int log = (bucket - 64) / 16 + 6;
+    return (1L << log) + ((long)((bucket - 64) % 16) << (log - 4));
+}
+
+static void start_run(struct run *run, const struct allocator *allocator, int timed, uint64_t seed, long limit){
+    memset(run, 0, sizeof(*run));
+    memset(blocks, 0, sizeof(blocks));
+    memset(sizes, 0, sizeof(sizes));
+    memset(small_blocks, 0, sizeof(small_blocks));
+    memset(small_sizes, 0, sizeof(small_sizes));
+    run->allocator = allocator;
+    run->timed = timed;
+    run->state = seed;
+    run->limit = limit;
+    run->rss = resident_pages();
+    run->peak_rss = run->rss;
+}
+
+static void sample_rss(struct run *run){
+    long rss = resident_pages();
+    if (rss > run->peak_rss){
+        run->peak_rss = rss;
+    }
+}
+
+// count an operation, sampling the resident size now and then
+static void count_op(struct run *run){
+    run->ops++;
+    if (run->ops % RSS_EVERY == 0){
+        sample_rss(run);
+    }
+}
+
+// allocate size bytes and write to every page of them, NULL if the allocator is out of memory
+static uint8_t *bench_malloc(struct run *run, size_t size){
+    uint8_t *ptr;
+    if (run->timed){
+        long begin = now_ns();
+        ptr = run->allocator->malloc(size);
+        run->latency[bucket_of(now_ns() - begin - clock_overhead)]++;
+    }
+    else{
+        ptr = run->allocator->malloc(size);
+    }
+    count_op(run);
+    if (ptr == NULL){
+        return NULL;
+    }
+
+    for (size_t offset = 0; offset < size; offset += page_size){
+        ptr[offset] = 1;
+    }
+    ptr[size - 1] = 1;
+    run->live += size;
+    if (run->live > run->peak_live){
+        run->peak_live = run->live;
+    }
+    return ptr;
+}
+
+static void bench_free(struct run *run, void *ptr, size_t size){
+    if (ptr == NULL){
+        return;
+    }
+    if (run->timed){
+        long begin = now_ns();
+        run->allocator->free(ptr);
+        run->latency[bucket_of(now_ns() - begin - clock_overhead)]++;
+    }
+    else{
+        run->allocator->free(ptr);
+    }
+    count_op(run);
+    run->live -= size;
+}
+
+// replace a random block of a window until the run is over, then free the window
+static void churn(struct run *run, size_t (*next_size)(struct run *run)){
+    void **window = blocks;
+    while (run->ops < run->limit){
+        int slot = next_random(&run->state) % WINDOW;
+        bench_free(run, window[slot], sizes[slot]);
+        sizes[slot] = next_size(run);
+        window[slot] = bench_malloc(run, sizes[slot]);
+    }
+    for (int slot = 0; slot < WINDOW; slot++){
+        bench_free(run, window[slot], sizes[slot]);
+        window[slot] = NULL;
+    }
+}
+
+static void uniform(struct run *run){
+    churn(run, uniform_size);
+}
+
+static void powerlaw(struct run *run){
+    churn(run, powerlaw_size);
+}
+
+static void burst(struct run *run){
+    while (run->ops < run->limit){
+        for (int i = 0; i < BURST; i++){
+            sizes[i] = powerlaw_size(run);
+            blocks[i] = bench_malloc(run, sizes[i]);
+        }
+        // free in a random order
+        for (int i = BURST - 1; i >= 0; i--){
+            int other = next_random(&run->state) % (i + 1);
+            bench_free(run, blocks[other], sizes[other]);
+            blocks[other] = blocks[i];
+            sizes[other] = sizes[i];
+        }
+    }
+}
+
+// the long-lived blocks sit after the window churn uses
+static void longlived(struct run *run){
+    for (int i = WINDOW; i < WINDOW + LONG_LIVED; i++){
+        sizes[i] = powerlaw_size(run);
+        blocks[i] = bench_malloc(run, sizes[i]);
+    }
+    churn(run, uniform_size);
+    for (int i = WINDOW; i < WINDOW + LONG_LIVED; i++){
+        bench_free(run, blocks[i], sizes[i]);
+    }
+}
+
+static void small(struct run *run){
+    while (run->ops < run->limit){
+        for (int i = 0; i < SMALL_BLOCKS; i++){
+            small_sizes[i] = 1 + next_random(&run->state) % 64;
+            small_blocks[i] = bench_malloc(run, small_sizes[i]);
+        }
+        // sample the resident size with every block live
+        sample_rss(run);
+        for (int i = 0; i < SMALL_BLOCKS; i++){
+            bench_free(run, small_blocks[i], small_sizes[i]);
+        }
+    }
+}
+
+// blocks passed from producer to consumer, NULL slots are empty
+struct ring {
+    _Atomic(uint8_t *) blocks[RING];
+    _Atomic size_t sizes[RING];
+    atomic_int done;
+};
+
+struct ring ring;
+struct run consumer_run;
+
+void *consumer(void *arg){
+    struct run *run = &consumer_run;
+    int slot = 0;
+    while (1){
+        uint8_t *block = atomic_load(&ring.blocks[slot]);
+        if (block == NULL){
+            if (atomic_load(&ring.done)){
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        size_t size = atomic_load(&ring.sizes[slot]);
+        atomic_store(&ring.blocks[slot], NULL);
+        bench_free(run, block, size);
+        slot = (slot + 1) % RING;
+    }
+    return NULL;
+}
+
+static void prodcons(struct run *run){
+    start_run(&consumer_run, run->allocator, run->timed, run->state + 1, 0);
+    atomic_store(&ring.done, 0);
+    pthread_t tid;
+    pthread_create(&tid, NULL, consumer, NULL);
+
+    // the consumer frees every block, the producer sees them leave the ring
+    size_t *in_ring = sizes;
+    int slot = 0;
+    while (run->ops < run->limit / 2){
+        size_t size = 1 + next_random(&run->state) % 512;
+        uint8_t *block = bench_malloc(run, size);
+        if (block == NULL){
+            break;
+        }
+        while (atomic_load(&ring.blocks[slot]) != NULL){
+            sched_yield();
+        }
+        run->live -= in_ring[slot];
+        in_ring[slot] = size;
+        atomic_store(&ring.sizes[slot], size);
+        atomic_store(&ring.blocks[slot], block);
+        slot = (slot + 1) % RING;
+    }
+    atomic_store(&ring.done, 1);
+    pthread_join(tid, NULL);
+
+    run->ops += consumer_run.ops;
+    if (consumer_run.peak_rss > run->peak_rss){
+        run->peak_rss = consumer_run.peak_rss;
+    }
+    for (int bucket = 0; bucket < BUCKETS; bucket++){
+        run->latency[bucket] += consumer_run.latency[bucket];
+    }
+}
+
+// latency at fraction of the timed operations
+static long percentile(struct run *run, double fraction){
+    long total = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++){
+        total += run->latency[bucket];
+    }
+    long seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++){
+        seen += run->latency[bucket];
+        if (seen > total * fraction){
+            return bucket_ns(bucket);
+        }
+    }
+    return bucket_ns(BUCKETS - 1);
+}
+
+// the clock is read twice around every timed operation
+static void calibrate_clock(){
+    clock_overhead = 1000000;
+    for (int i = 0; i < 1000; i++){
+        long begin = now_ns();
+        long elapsed = now_ns() - begin;
+        if (elapsed < clock_overhead){
+            clock_overhead = elapsed;
+        }
+    }
+}
+
+struct workload {
+    const char *name;
+    void (*run)(struct run *run);
+    int threaded;
+};
+
+const struct workload workloads[] = {
+    {"uniform", uniform, 0},
+    {"powerlaw", powerlaw, 0},
+    {"prodcons", prodcons, 1},
+    {"burst", burst, 0},
+    {"longlived", longlived, 0},
+    {"small", small, 0}
+};
+
+/*
+ * Run workload on allocator in a child process, and fill in run and the
+ * seconds it took. Return 0 if succeed, return 1 if the child failed.
+ */
+static int run_child(const struct workload *workload, const struct allocator *allocator, int timed,
+        struct run *run, double *seconds){
+    int pipe_fds[2];
+    if (pipe(pipe_fds)){
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0){
+        return 1;
+    }
+
+    if (pid == 0){
+        close(pipe_fds[0]);
+        if (allocator->init(workload->threaded)){
+            _exit(1);
+        }
+        start_run(run, allocator, timed, 0x9E3779B97F4A7C15ULL, ops_per_workload);
+        long begin = now_ns();
+        workload->run(run);
+        *seconds = (now_ns() - begin) / 1e9;
+        if (write(pipe_fds[1], run, sizeof(*run)) != sizeof(*run)
+                || write(pipe_fds[1], seconds, sizeof(*seconds)) != sizeof(*seconds)){
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(pipe_fds[1]);
+    int failed = read(pipe_fds[0], run, sizeof(*run)) != sizeof(*run)
+            || read(pipe_fds[0], seconds, sizeof(*seconds)) != sizeof(*seconds);
+    close(pipe_fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return failed || !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char *argv[]){
+    if (argc > 1){
+        ops_per_workload = atol(argv[1]);
+    }
+    if (argc > 2 || ops_per_workload < 1){
+        fprintf(stderr, "Usage: %s [operations_per_workload]\n", argv[0]);
+        return 1;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+    calibrate_clock();
+
+    fputs(" workload    allocator          ops/s   p50 ns   p99 ns   peak MB    frag\n", stdout);
+    fputs("--------------------------------------------------------------------------\n", stdout);
+    int workload_num = sizeof(workloads) / sizeof(workloads[0]);
+    int allocator_num = sizeof(allocators) / sizeof(allocators[0]);
+    for (int w = 0; w < workload_num; w++){
+        for (int a = 0; a < allocator_num; a++){
+            struct run run;
+            double seconds;
+            if (run_child(&workloads[w], &allocators[a], 0, &run, &seconds)){
+                fprintf(stderr, "Error: %s failed on %s.\n", workloads[w].name, allocators[a].name);
+                return 1;
+            }
+            double rate = run.ops / seconds;
+            double peak = (double)(run.peak_rss - run.rss) * page_size;
+            double fragmentation = peak > 0 ? 1 - run.peak_live / peak : 0;
+
+            if (run_child(&workloads[w], &allocators[a], 1, &run, &seconds)){
+                fprintf(stderr, "Error: %s failed on %s.\n", workloads[w].name, allocators[a].name);
+                return 1;
+            }
+            fprintf(stdout, " %-10s  %-12s  %10.0f   %6ld   %6ld   %7.1f   %4.0f%%\n",
+                    a == 0 ? workloads[w].name : "", allocators[a].name, rate,
+                    percentile(&run, 0.5), percentile(&run, 0.99),
+                    peak / (1 << 20), fragmentation * 100);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -1,3 +1,12 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #include "libmem.h"
 
 // Global value pointing to current PCB
@@ -8,43 +17,2628 @@ uint32_t getCurrentPID(){
     return currentPCB->pid;
 }
 
-// pointer to the start of 128MB pool
+/*
+ * The pool is a reserved range of virtual memory, of which the first
+ * pool_size bytes are mapped. It starts out with the size given to
+ * myInitializeMemoryConfig and grows a chunk at a time when it runs out,
+ * up to its limit. Chunks are mapped back to back, so the pool stays one
+ * range and the side tables below index it linearly. Each chunk ends with
+ * a fence. Under the free list engine the fence closing the pool opens
+ * the next chunk, so a free region at the end of the pool grows into it,
+ * as far as a region can hold.
+ */
+#define CHUNK_MAX ((size_t)1 << 33) // region sizes are 30 bits of 8-byte units
+#define POOL_MIN_SIZE (1 << 16)
+#define POOL_LIMIT_MAX ((size_t)1 << 40) // keeps the side tables within reach
+
+// pointer to the start of the pool
 struct mem_region *pool = NULL;
 
-// size of mem_region (should be 8)
-int mem_region_size = (int)sizeof(struct mem_region);
+// bytes of the pool mapped so far
+size_t pool_size = 0;
+
+static size_t chunk_size; // the pool grows in multiples of chunk_size
+static size_t pool_limit; // bytes reserved for the pool
+
+/*
+ * Bookkeeping outside the pool (the PCBs and the side tables) is mapped
+ * from the OS directly instead of taken from the system malloc, so
+ * libmem can stand in for malloc itself (see preload.c).
+ * Its pages read as zero and are committed on first touch.
+ */
+static void *map_zeroed(size_t size){
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+static void unmap_zeroed(void *mapping, size_t size){
+    if (mapping != NULL){
+        munmap(mapping, size);
+    }
+}
+
+// size of mem_region (should be 8)
+int mem_region_size = (int)sizeof(struct mem_region);
+
+_Static_assert(offsetof(struct mem_region, data) == 8, "region data must start 8 bytes in");
+
+/*
+ * Free regions are kept in segregated free lists, one per size class.
+ * The links live in the (otherwise unused) data area of a free region,
+ * so every region must have room for them.
+ * Sizes up to SMALL_CLASS_MAX get an exact class per 8 bytes; larger
+ * sizes get four classes per power of two.
+ */
+#define NUM_CLASSES 128
+#define SMALL_CLASS_MAX 256
+#define MIN_REGION_SIZE 24 // room for the free list links and footer
+#define SPLIT_THRESHOLD 64 // split only if more than 64 bytes are left over
+
+struct free_links {
+    struct mem_region *next;
+    struct mem_region *prev;
+};
+
+#define EXACT_CLASSES (SMALL_CLASS_MAX / 8 - 1) // classes of a single size
+
+// heads of the free lists, and a bitmap of the non-empty ones
+struct heap {
+    struct mem_region *free_lists[NUM_CLASSES];
+    uint64_t free_lists_map[NUM_CLASSES / 64];
+    struct mem_region *rover; // where next fit resumes, NULL for the head of a list
+    struct mem_region *tree; // regions past the exact classes, for tree fit
+};
+
+/*
+ * The placement policy picks the free region find_free_region hands out.
+ * Good fit takes the head of the first list whose regions all fit, in
+ * constant time, at the price of splitting larger regions than needed.
+ * Next fit searches the list of the size first fit, from the region after
+ * the last one it handed out, so the searches do not all rescan the same
+ * regions at the head of the list. Best fit searches for the smallest
+ * region that fits, which takes a scan of whole lists. Tree fit finds it
+ * in a treap of the free regions past the exact classes, ordered by size
+ * and address, which is only kept while the policy is in use.
+ */
+static enum mem_policy placement;
+
+/*
+ * Counters for myMemoryStats. The free lists and engines count into
+ * heap_stats under the heap lock, and so do the calls, unless a thread
+ * cache serves them (see lock_stats).
+ */
+static struct mem_stats heap_stats;
+
+/*
+ * Every process allocates from its own arena. An arena is a list of
+ * spans: used regions of the pool whose data is cut into regions again,
+ * with free lists of their own. Spans come from pool_heap, the free
+ * lists of the pool itself, and go back there as a whole, so tearing
+ * down a process does not touch its regions one by one.
+ *
+ * Layout of a span's data:
+ *   | regions ... | fence | struct span |
+ * The fence is a used region of size 0, so no region merges past it.
+ * Every chunk of the pool ends with a fence too.
+ */
+#define SPAN_SIZE (1 << 20) // data size of an ordinary span
+
+struct span {
+    struct arena *arena;
+    struct span *next;
+    struct span *prev;
+    struct mem_region *region; // the span's own region in the pool
+};
+
+/*
+ * Slabs serve allocations of up to SLAB_MAX bytes. A slab is a region the
+ * engine hands an arena, filling a SLAB_SIZE-aligned page of the pool,
+ * with its data cut into equal objects without bookkeeping sections.
+ * Bitmaps in front of the objects tell which ones are free, and which
+ * ones are waiting on a thread cache's remote_frees stack. A table over
+ * the pool marks slab pages, so myFree tells a slab object from a region
+ * in constant time.
+ * The bookkeeping of a slab starts a cache line further into the page for
+ * every size class, cycling through SLAB_COLORS lines as far as the space
+ * left over by the objects allows, so the slabs in use do not all compete
+ * for the same cache sets.
+ * Slabs with free objects are listed in their arena per object size.
+ * In multithreaded mode a thread cache can own a slab, and then takes
+ * and returns its objects without the lock.
+ */
+#define SLAB_SIZE 16384
+#define SLAB_MAX 256 // largest object
+#define SLAB_CLASSES (SLAB_MAX / 8) // one per multiple of 8 bytes
+#define SLAB_COLOR 64 // cache line
+#define SLAB_COLORS 16
+
+_Static_assert(SLAB_SIZE / 8 / 64 <= 32, "free_map words must fit in nonempty");
+
+struct slab {
+    struct arena *arena;
+    struct slab *next; // slabs with free objects, of the arena or the owning cache
+    struct slab *prev;
+    struct slab *owned_next; // slabs of the owning thread cache
+    struct slab *owned_prev;
+    int listed;
+    atomic_int owner; // thread cache owning the slab, 0 if none
+    uint32_t object_size;
+    uint32_t reciprocal; // 2^32 / object_size rounded up, to divide by it
+    uint32_t objects;
+    uint32_t used;
+    uint32_t nonempty; // bitmap of the free_map words with a free object
+    uint8_t *first; // first object
+    _Atomic uint64_t *pending; // bitmap of objects on a remote_frees stack
+    _Atomic uint64_t free_map[]; // bitmap of free objects, read by any thread
+};
+
+struct arena {
+    uint32_t pid;
+    unsigned generation; // bumped every time the arena is emptied
+    struct heap heap;
+    struct span *spans;
+    struct slab *slabs[SLAB_CLASSES];
+};
+
+// a PCB together with its arena
+struct process {
+    struct pcb pcb;
+    struct arena arena;
+};
+
+// bytes of a span's data that are not regions
+#define SPAN_OVERHEAD (mem_region_size + sizeof(struct span))
+
+/*
+ * An engine manages the pool below the arenas and thread caches.
+ * Engines share the bookkeeping section and the side table, so
+ * myFreeErrorCode and the thread caches work the same on top of either.
+ * Caller holds the heap lock.
+ */
+struct engine_ops {
+    void (*add_chunk)(struct mem_region *chunk, size_t size);
+    struct mem_region *(*alloc)(struct arena *arena, size_t size);
+    // stores the data addresses, returns how many blocks it allocated
+    size_t (*alloc_batch)(struct arena *arena, size_t size, size_t count, void **out);
+    void (*free)(struct arena *arena, struct mem_region *region);
+    // frees the blocks from first to last, which lie one after the other
+    void (*free_run)(struct arena *arena, struct mem_region *first, struct mem_region *last);
+    size_t (*free_all)(struct arena *arena); // returns the bytes that were in use
+    int (*resize)(struct arena *arena, struct mem_region *region, size_t size);
+    // data starts offset bytes past a multiple of align from the start of the pool
+    struct mem_region *(*alloc_aligned)(struct arena *arena, size_t size, size_t align, size_t offset);
+    void (*walk)(void (*visit)(uint32_t pid, int free, size_t size, void *addr));
+    // a region filling a SLAB_SIZE-aligned page, for a slab
+    struct mem_region *(*alloc_slab)(struct arena *arena);
+};
+
+static const struct engine_ops *engine;
+
+static struct heap pool_heap;
+
+/*
+ * Side table with one bit per 8 bytes of the pool, set where a region
+ * (and so its bookkeeping section) starts. It answers whether a pointer
+ * is a block address without walking the pool.
+ * Only regions inside spans are marked; spans themselves are not
+ * block addresses.
+ */
+static uint64_t *region_starts = NULL;
+
+// mark or unmark the start of region in the side table
+static void set_region_start(struct mem_region *region, int is_start){
+    size_t granule = ((uint8_t *)region - (uint8_t *)pool) / 8;
+    if (is_start){
+        region_starts[granule / 64] |= 1ULL << (granule % 64);
+    }
+    else{
+        region_starts[granule / 64] &= ~(1ULL << (granule % 64));
+    }
+}
+
+// check if a region starts at region
+static int is_region_start(struct mem_region *region){
+    size_t granule = ((uint8_t *)region - (uint8_t *)pool) / 8;
+    return (region_starts[granule / 64] >> (granule % 64)) & 1;
+}
+
+// unmark every region starting in [begin, end)
+static void clear_region_starts(void *begin, void *end){
+    size_t first = ((uint8_t *)begin - (uint8_t *)pool) / 8;
+    size_t last = ((uint8_t *)end - (uint8_t *)pool) / 8;
+    while (first < last && first % 64){
+        region_starts[first / 64] &= ~(1ULL << (first % 64));
+        first++;
+    }
+    if (last - first >= 64){
+        memset(&region_starts[first / 64], 0, (last - first) / 64 * sizeof(uint64_t));
+        first += (last - first) / 64 * 64;
+    }
+    while (first < last){
+        region_starts[first / 64] &= ~(1ULL << (first % 64));
+        first++;
+    }
+}
+
+// slab pages of the pool, one byte per SLAB_SIZE bytes: 0 if none, else 1 + the
+// offset of the slab into the region's data in 8 bytes
+static uint8_t *slab_pages = NULL;
+
+// index of the slab page ptr points into
+static size_t slab_page(void *ptr){
+    return ((uint8_t *)ptr - (uint8_t *)pool) / SLAB_SIZE;
+}
+
+// check if ptr points into a slab
+static int is_slab_object(void *ptr){
+    return slab_pages[slab_page(ptr)] != 0;
+}
+
+// slab ptr points into
+static struct slab *slab_of(void *ptr){
+    size_t page = slab_page(ptr);
+    struct mem_region *region = (struct mem_region *)((uint8_t *)pool + page * SLAB_SIZE);
+    return (struct slab *)(region->data + (slab_pages[page] - 1) * 8);
+}
+
+// unmark every slab page starting in [begin, end)
+static void clear_slab_pages(void *begin, void *end){
+    size_t first = ((uint8_t *)begin - (uint8_t *)pool + SLAB_SIZE - 1) / SLAB_SIZE;
+    size_t last = ((uint8_t *)end - (uint8_t *)pool + SLAB_SIZE - 1) / SLAB_SIZE;
+    if (first < last){
+        memset(&slab_pages[first], 0, last - first);
+    }
+}
+
+// regions of pool_heap are spans, which are not tracked in the side table
+static void track_region(struct heap *heap, struct mem_region *region, int is_start){
+    if (heap != &pool_heap){
+        set_region_start(region, is_start);
+    }
+}
+
+// links of a free region
+static struct free_links *links_of(struct mem_region *region){
+    return (struct free_links *)region->data;
+}
+
+// data size of region in bytes
+static size_t region_size(struct mem_region *region){
+    return (size_t)region->units * 8;
+}
+
+// set the data size of region, a multiple of 8 bytes
+static void set_region_size(struct mem_region *region, size_t size){
+    region->units = size / 8;
+}
+
+// physically next region in the pool
+static struct mem_region *next_region(struct mem_region *region){
+    return (struct mem_region *)&region->data[region_size(region)];
+}
+
+// check if region is the fence closing the pool or a span
+static int is_fence(struct mem_region *region){
+    return region->units == 0;
+}
+
+// physically previous region, only valid if region->prev_free is set
+static struct mem_region *prev_region(struct mem_region *region){
+    size_t prev_size = *((size_t *)region - 1);
+    return (struct mem_region *)((uint8_t *)region - prev_size - mem_region_size);
+}
+
+// mark region as free: write its footer and tell the next region about it
+static void mark_free(struct mem_region *region){
+    region->free = 1;
+    *(size_t *)&region->data[region_size(region) - sizeof(size_t)] = region_size(region);
+    next_region(region)->prev_free = 1;
+}
+
+// mark region as allocated to the current process
+static void mark_used(struct mem_region *region){
+    region->free = 0;
+    region->pid = getCurrentPID();
+    next_region(region)->prev_free = 0;
+}
+
+// size class of a region with size bytes of data
+static int size_class(size_t size){
+    if (size <= SMALL_CLASS_MAX){
+        return (int)(size / 8) - 2;
+    }
+    int log = 63 - __builtin_clzl(size);
+    int class = (SMALL_CLASS_MAX / 8 - 1) + (log - 8) * 4 + (int)((size >> (log - 2)) & 3);
+    // the last class takes every size from 4GB up
+    return class < NUM_CLASSES ? class : NUM_CLASSES - 1;
+}
+
+// smallest size class in which every region can hold size bytes
+static int fitting_class(size_t size){
+    int class = size_class(size);
+    if (class == NUM_CLASSES - 1){
+        return NUM_CLASSES; // no class past the last one
+    }
+    if (size > SMALL_CLASS_MAX){
+        int log = 63 - __builtin_clzl(size);
+        // size is not the lower bound of its class
+        if (size & ((1UL << (log - 2)) - 1)){
+            class++;
+        }
+    }
+    return class;
+}
+
+// first non-empty free list of heap at or above class, -1 if there is none
+static int next_nonempty_class(struct heap *heap, int class){
+    for (int word = class / 64; word < NUM_CLASSES / 64; word++){
+        uint64_t bits = heap->free_lists_map[word];
+        if (word == class / 64){
+            bits &= ~0ULL << (class % 64);
+        }
+        if (bits){
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+// children in the tree of a free region past the exact classes, after its links
+struct tree_links {
+    struct mem_region *left;
+    struct mem_region *right;
+};
+
+// bytes at the front of a free region its links may take, kept when pages are released
+#define FREE_LINKS_SIZE (sizeof(struct free_links) + sizeof(struct tree_links))
+
+static struct tree_links *tree_links_of(struct mem_region *region){
+    return (struct tree_links *)(region->data + sizeof(struct free_links));
+}
+
+// regions are ordered by size, and by address among the same size
+static int tree_less(struct mem_region *a, struct mem_region *b){
+    return region_size(a) != region_size(b) ? region_size(a) < region_size(b) : a < b;
+}
+
+// treap priority, a hash of the address
+static uint32_t tree_priority(struct mem_region *region){
+    return ((uintptr_t)region * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+// insert region into the tree at root, return the new root
+static struct mem_region *tree_insert(struct mem_region *root, struct mem_region *region){
+    if (root == NULL){
+        tree_links_of(region)->left = NULL;
+        tree_links_of(region)->right = NULL;
+        return region;
+    }
+    struct tree_links *links = tree_links_of(root);
+    if (tree_less(region, root)){
+        links->left = tree_insert(links->left, region);
+        if (tree_priority(links->left) > tree_priority(root)){
+            struct mem_region *left = links->left;
+            links->left = tree_links_of(left)->right;
+            tree_links_of(left)->right = root;
+            return left;
+        }
+    }
+    else{
+        links->right = tree_insert(links->right, region);
+        if (tree_priority(links->right) > tree_priority(root)){
+            struct mem_region *right = links->right;
+            links->right = tree_links_of(right)->left;
+            tree_links_of(right)->left = root;
+            return right;
+        }
+    }
+    return root;
+}
+
+// join trees with every region of left before every region of right
+static struct mem_region *tree_join(struct mem_region *left, struct mem_region *right){
+    if (left == NULL){
+        return right;
+    }
+    if (right == NULL){
+        return left;
+    }
+    if (tree_priority(left) > tree_priority(right)){
+        tree_links_of(left)->right = tree_join(tree_links_of(left)->right, right);
+        return left;
+    }
+    tree_links_of(right)->left = tree_join(left, tree_links_of(right)->left);
+    return right;
+}
+
+// remove region from the tree at root, return the new root
+static struct mem_region *tree_remove(struct mem_region *root, struct mem_region *region){
+    struct tree_links *links = tree_links_of(root);
+    if (root == region){
+        return tree_join(links->left, links->right);
+    }
+    if (tree_less(region, root)){
+        links->left = tree_remove(links->left, region);
+    }
+    else{
+        links->right = tree_remove(links->right, region);
+    }
+    return root;
+}
+
+// check if region is kept in the tree of its heap
+static int in_tree(struct mem_region *region){
+    return placement == MEM_POLICY_TREE_FIT && size_class(region_size(region)) >= EXACT_CLASSES;
+}
+
+// push a free region to the front of its free list
+static void insert_free_region(struct heap *heap, struct mem_region *region){
+    int class = size_class(region_size(region));
+    struct free_links *links = links_of(region);
+    links->prev = NULL;
+    links->next = heap->free_lists[class];
+    if (links->next != NULL){
+        links_of(links->next)->prev = region;
+    }
+    heap->free_lists[class] = region;
+    heap->free_lists_map[class / 64] |= 1ULL << (class % 64);
+    if (in_tree(region)){
+        heap->tree = tree_insert(heap->tree, region);
+    }
+}
+
+// unlink a free region from its free list
+static void remove_free_region(struct heap *heap, struct mem_region *region){
+    int class = size_class(region_size(region));
+    struct free_links *links = links_of(region);
+    if (links->prev != NULL){
+        links_of(links->prev)->next = links->next;
+    }
+    else{
+        heap->free_lists[class] = links->next;
+        if (links->next == NULL){
+            heap->free_lists_map[class / 64] &= ~(1ULL << (class % 64));
+        }
+    }
+    if (links->next != NULL){
+        links_of(links->next)->prev = links->prev;
+    }
+    if (heap->rover == region){
+        heap->rover = links->next;
+    }
+    if (in_tree(region)){
+        heap->tree = tree_remove(heap->tree, region);
+    }
+}
+
+// first fit in the list of size, from the rover round to it again
+static struct mem_region *next_fit(struct heap *heap, size_t size){
+    int class = size_class(size);
+    struct mem_region *head = heap->free_lists[class];
+    struct mem_region *start = heap->rover;
+    if (start == NULL || size_class(region_size(start)) != class){
+        start = head;
+    }
+    for (struct mem_region *region = start; region != NULL; ){
+        heap_stats.scanned++;
+        if (region_size(region) >= size){
+            heap->rover = links_of(region)->next;
+            return region;
+        }
+        region = links_of(region)->next;
+        if (region == NULL && start != head){
+            region = head;
+        }
+        if (region == start){
+            break;
+        }
+    }
+
+    // every region of the lists past it fits
+    class = next_nonempty_class(heap, class + 1);
+    if (class < 0){
+        return NULL;
+    }
+    heap_stats.scanned++;
+    return heap->free_lists[class];
+}
+
+// smallest region that fits, searched in the lists from the one of size
+static struct mem_region *best_fit(struct heap *heap, size_t size){
+    for (int class = size_class(size); class >= 0; ){
+        struct mem_region *best = NULL;
+        for (struct mem_region *region = heap->free_lists[class]; region != NULL;
+                region = links_of(region)->next){
+            heap_stats.scanned++;
+            if (region_size(region) >= size
+                    && (best == NULL || region_size(region) < region_size(best))){
+                best = region;
+                if (region_size(best) == size){
+                    break;
+                }
+            }
+        }
+        if (best != NULL || class == NUM_CLASSES - 1){
+            return best;
+        }
+        class = next_nonempty_class(heap, class + 1);
+    }
+    return NULL;
+}
+
+// smallest region that fits, the head of an exact class or found in the tree
+static struct mem_region *tree_fit(struct heap *heap, size_t size){
+    int class = next_nonempty_class(heap, size_class(size));
+    if (class >= 0 && class < EXACT_CLASSES){
+        heap_stats.scanned++;
+        return heap->free_lists[class];
+    }
+    struct mem_region *best = NULL;
+    for (struct mem_region *node = heap->tree; node != NULL; ){
+        heap_stats.scanned++;
+        if (region_size(node) >= size){
+            best = node;
+            node = tree_links_of(node)->left;
+        }
+        else{
+            node = tree_links_of(node)->right;
+        }
+    }
+    return best;
+}
+
+/*
+ * Find a free region with at least size bytes of data, as the placement
+ * policy says. For good fit any region of a fitting class will do, so
+ * this takes the head of the first non-empty list; only when no such list
+ * exists the (smaller) class of size itself is searched first fit.
+ */
+static struct mem_region *find_free_region(struct heap *heap, size_t size){
+    heap_stats.searches++;
+    if (placement == MEM_POLICY_NEXT_FIT){
+        return next_fit(heap, size);
+    }
+    if (placement == MEM_POLICY_BEST_FIT){
+        return best_fit(heap, size);
+    }
+    if (placement == MEM_POLICY_TREE_FIT){
+        return tree_fit(heap, size);
+    }
+    int class = next_nonempty_class(heap, fitting_class(size));
+    if (class >= 0){
+        heap_stats.scanned++;
+        return heap->free_lists[class];
+    }
+    struct mem_region *head = heap->free_lists[size_class(size)];
+    while (head != NULL){
+        heap_stats.scanned++;
+        if (region_size(head) >= size){
+            break;
+        }
+        head = links_of(head)->next;
+    }
+    return head;
+}
+
+/*
+ * The pool is an anonymous mapping, so the OS only commits its pages once
+ * they are touched. Whenever a free region of at least RELEASE_MIN bytes
+ * forms, its pages go back to the OS, so the resident size follows the
+ * live heap. Only whole pages strictly inside the region are released,
+ * which leaves its links and footer alone; released pages read
+ * as zeros when they are touched again. A free region that large had its
+ * pages released when it formed, so merging with one only has to release
+ * the pages of the smaller parts and of its bookkeeping section.
+ * So every whole page inside a free region that large reads as zeros,
+ * except the ones holding its links and footer, which myCalloc relies on.
+ */
+#define RELEASE_MIN SPAN_SIZE
+
+static size_t page_size;
+
+// whether the region handed out last came from a free region of at least
+// RELEASE_MIN bytes, only valid under the heap lock right after the allocation
+static int zero_pages;
+
+// release the pages of free region in [begin, end)
+static void release_pages(struct mem_region *region, uint8_t *begin, uint8_t *end){
+    uint8_t *data_begin = region->data + FREE_LINKS_SIZE;
+    uint8_t *data_end = region->data + region_size(region) - sizeof(size_t);
+    // every page touched by [begin, end), but none holding the links or footer
+    uintptr_t first = (uintptr_t)begin & ~(page_size - 1);
+    uintptr_t last = ((uintptr_t)end + page_size - 1) & ~(page_size - 1);
+    uintptr_t data_first = ((uintptr_t)data_begin + page_size - 1) & ~(page_size - 1);
+    uintptr_t data_last = (uintptr_t)data_end & ~(page_size - 1);
+    first = first > data_first ? first : data_first;
+    last = last < data_last ? last : data_last;
+    if (first < last){
+        madvise((void *)first, last - first, MADV_DONTNEED);
+    }
+}
+
+/*
+ * Hand out mem, taken off the free lists of heap, for size bytes,
+ * splitting off the rest if it is worth it.
+ */
+static struct mem_region *use_region(struct heap *heap, struct mem_region *mem, size_t size){
+    zero_pages = region_size(mem) >= RELEASE_MIN;
+
+    // split if the space left over is larger than 64
+    if (region_size(mem) - size > SPLIT_THRESHOLD){
+        struct mem_region *next;
+        next = (struct mem_region *)&mem->data[size];
+        next->prev_free = 0;
+        set_region_size(next, region_size(mem) - size - mem_region_size);
+        next->pid = 0;
+        track_region(heap, next, 1);
+        mark_free(next);
+        insert_free_region(heap, next);
+        set_region_size(mem, size);
+        heap_stats.splits++;
+    }
+
+    mark_used(mem);
+    return mem;
+}
+
+/*
+ * Take a region with at least size bytes of data from the free lists
+ * of heap. Caller holds the heap lock.
+ */
+static struct mem_region *heap_alloc(struct heap *heap, size_t size){
+    // bookkeeping section to be allocated
+    struct mem_region *mem = find_free_region(heap, size);
+
+    // cannot find the appropriate block
+    if (mem == NULL){
+        return NULL;
+    }
+    remove_free_region(heap, mem);
+    return use_region(heap, mem, size);
+}
+
+/*
+ * Like heap_alloc, but the data of the region starts offset bytes past a
+ * multiple of align (a power of two larger than offset) bytes from the
+ * start of the pool. The padding in front goes back to the free lists as
+ * a region of its own.
+ */
+static struct mem_region *heap_alloc_aligned(struct heap *heap, size_t size, size_t align, size_t offset){
+    // a region that happens to be aligned needs no padding, if it is not
+    // taken the probe leaves next fit to resume where it did before
+    struct mem_region *rover = heap->rover;
+    struct mem_region *mem = find_free_region(heap, size);
+    if (mem != NULL && ((mem->data - (uint8_t *)pool) & (align - 1)) == offset){
+        remove_free_region(heap, mem);
+        return use_region(heap, mem, size);
+    }
+    heap->rover = rover;
+
+    // worst case padding, which has to hold a free region
+    mem = find_free_region(heap, size + align + mem_region_size + MIN_REGION_SIZE);
+    if (mem == NULL){
+        return NULL;
+    }
+    remove_free_region(heap, mem);
+
+    size_t start = mem->data - (uint8_t *)pool;
+    size_t aligned = ((start - offset + align - 1) & ~(align - 1)) + offset;
+    if (aligned != start){
+        while (aligned - start < mem_region_size + MIN_REGION_SIZE){
+            aligned += align;
+        }
+        struct mem_region *front = mem;
+        mem = (struct mem_region *)((uint8_t *)pool + aligned) - 1;
+        set_region_size(mem, region_size(front) - (aligned - start));
+        mem->pid = 0;
+        set_region_size(front, aligned - start - mem_region_size);
+        track_region(heap, mem, 1);
+        mark_free(front);
+        insert_free_region(heap, front);
+        heap_stats.splits++;
+    }
+    return use_region(heap, mem, size);
+}
+
+/*
+ * Give an allocated region back to the free lists of heap, merging it
+ * with its free neighbours. Return the merged region.
+ * Caller holds the heap lock.
+ */
+static struct mem_region *heap_free(struct heap *heap, struct mem_region *head){
+
+    // pages that may have been touched since they were last released
+    uint8_t *dirty_begin = (uint8_t *)head;
+    uint8_t *dirty_end = head->data + region_size(head);
+
+    // possibly merge with next block, if a region can hold both
+    struct mem_region *next = next_region(head);
+    if (next->free && region_size(head) + mem_region_size + region_size(next) < CHUNK_MAX){
+        remove_free_region(heap, next);
+        track_region(heap, next, 0);
+        dirty_end = region_size(next) < RELEASE_MIN ? next->data + region_size(next) : next->data + FREE_LINKS_SIZE;
+        set_region_size(head, region_size(head) + mem_region_size + region_size(next));
+        heap_stats.coalesces++;
+    }
+
+    // possibly merge with previous block, found through its footer
+    if (head->prev_free && *((size_t *)head - 1) + mem_region_size + region_size(head) < CHUNK_MAX){
+        struct mem_region *prev = prev_region(head);
+        remove_free_region(heap, prev);
+        track_region(heap, head, 0);
+        dirty_begin = region_size(prev) < RELEASE_MIN ? (uint8_t *)prev : (uint8_t *)head - sizeof(size_t);
+        set_region_size(prev, region_size(prev) + mem_region_size + region_size(head));
+        head = prev;
+        heap_stats.coalesces++;
+    }
+
+    // deallocate
+    mark_free(head);
+    insert_free_region(heap, head);
+    if (region_size(head) >= RELEASE_MIN){
+        release_pages(head, dirty_begin, dirty_end);
+    }
+    return head;
+}
+
+/*
+ * Resize an allocated region of heap in place to size bytes, by splitting
+ * off its tail or by taking in the free region after it.
+ * Return 0 if succeed, return 1 if the region after it has no room.
+ * Caller holds the heap lock.
+ */
+static int heap_resize(struct heap *heap, struct mem_region *head, size_t size){
+    if (size <= region_size(head)){
+        // split if the space left over is larger than 64
+        if (region_size(head) - size > SPLIT_THRESHOLD){
+            struct mem_region *tail = (struct mem_region *)&head->data[size];
+            tail->free = 0;
+            tail->prev_free = 0;
+            set_region_size(tail, region_size(head) - size - mem_region_size);
+            tail->pid = head->pid;
+            track_region(heap, tail, 1);
+            set_region_size(head, size);
+            heap_stats.splits++;
+            heap_free(heap, tail);
+        }
+        return 0;
+    }
+
+    struct mem_region *next = next_region(head);
+    if (!next->free || region_size(head) + mem_region_size + region_size(next) < size){
+        return 1;
+    }
+    remove_free_region(heap, next);
+    track_region(heap, next, 0);
+    set_region_size(head, region_size(head) + mem_region_size + region_size(next));
+    heap_stats.coalesces++;
+    use_region(heap, head, size);
+    return 0;
+}
+
+static int grow_pool(size_t size);
+
+// allocate a region of size bytes from pool_heap, growing the pool if it has no room
+static struct mem_region *pool_alloc(size_t size){
+    struct mem_region *region = heap_alloc(&pool_heap, size);
+    if (region == NULL && grow_pool(size + 2 * mem_region_size) == 0){
+        region = heap_alloc(&pool_heap, size);
+    }
+    return region;
+}
+
+/*
+ * Take a span from the pool for arena, large enough for a region of
+ * size bytes. Return 0 if succeed, return 1 if the pool is exhausted.
+ */
+static int add_span(struct arena *arena, size_t size){
+    size_t needed = mem_region_size + size + SPAN_OVERHEAD;
+    struct mem_region *region = NULL;
+    if (needed < SPAN_SIZE){
+        region = pool_alloc(SPAN_SIZE);
+    }
+    // also the fallback for a pool too full for an ordinary span
+    if (region == NULL){
+        region = pool_alloc(needed);
+    }
+    if (region == NULL){
+        return 1;
+    }
+    region->pid = arena->pid;
+
+    struct mem_region *fence = (struct mem_region *)&region->data[region_size(region) - SPAN_OVERHEAD];
+    fence->free = 0;
+    set_region_size(fence, 0);
+    fence->pid = arena->pid;
+
+    struct span *span = (struct span *)(fence + 1);
+    span->arena = arena;
+    span->region = region;
+    span->prev = NULL;
+    span->next = arena->spans;
+    if (span->next != NULL){
+        span->next->prev = span;
+    }
+    arena->spans = span;
+
+    struct mem_region *first = (struct mem_region *)region->data;
+    first->prev_free = 0;
+    set_region_size(first, region_size(region) - SPAN_OVERHEAD - mem_region_size);
+    first->pid = arena->pid;
+    set_region_start(first, 1);
+    mark_free(first);
+    insert_free_region(&arena->heap, first);
+    return 0;
+}
+
+// give a span back to the pool, whatever regions it holds
+static void release_span(struct span *span){
+    struct arena *arena = span->arena;
+    if (span->prev != NULL){
+        span->prev->next = span->next;
+    }
+    else{
+        arena->spans = span->next;
+    }
+    if (span->next != NULL){
+        span->next->prev = span->prev;
+    }
+
+    struct mem_region *region = span->region;
+    clear_region_starts(region->data, span);
+    clear_slab_pages(region->data, span);
+    heap_free(&pool_heap, region);
+}
+
+// allocate a region of size bytes from arena, adding a span if needed
+static struct mem_region *arena_alloc(struct arena *arena, size_t size){
+    struct mem_region *region = heap_alloc(&arena->heap, size);
+    if (region == NULL && add_span(arena, size) == 0){
+        region = heap_alloc(&arena->heap, size);
+    }
+    return region;
+}
+
+// allocate an aligned region of size bytes from arena, adding a span if needed
+static struct mem_region *arena_alloc_aligned(struct arena *arena, size_t size, size_t align, size_t offset){
+    struct mem_region *region = heap_alloc_aligned(&arena->heap, size, align, offset);
+    if (region == NULL
+            && add_span(arena, size + align + mem_region_size + MIN_REGION_SIZE) == 0){
+        region = heap_alloc_aligned(&arena->heap, size, align, offset);
+    }
+    return region;
+}
+
+/*
+ * Cut free region mem, taken off the free lists of heap, into up to count
+ * regions of size bytes in a row, as many as it holds, and store their
+ * data addresses in out. Return how many it was cut into.
+ */
+static size_t carve_region(struct heap *heap, struct mem_region *mem, size_t size, size_t count, void **out){
+    size_t stride = mem_region_size + size;
+    size_t fits = (region_size(mem) + mem_region_size) / stride;
+    if (count > fits){
+        count = fits;
+    }
+    for (size_t i = 0; i + 1 < count; i++){
+        struct mem_region *next = (struct mem_region *)&mem->data[size];
+        next->free = 0;
+        next->prev_free = 0;
+        set_region_size(next, region_size(mem) - stride);
+        track_region(heap, next, 1);
+        set_region_size(mem, size);
+        mark_used(mem);
+        out[i] = mem->data;
+        mem = next;
+        heap_stats.splits++;
+    }
+    out[count - 1] = use_region(heap, mem, size)->data;
+    return count;
+}
+
+/*
+ * Allocate count regions of size bytes from arena into out, carving them
+ * from one free region large enough for all of them if there is one, and
+ * otherwise from as few as it takes, adding spans if needed.
+ * Return how many were allocated.
+ */
+static size_t arena_alloc_batch(struct arena *arena, size_t size, size_t count, void **out){
+    size_t stride = mem_region_size + size;
+    size_t done = 0;
+    while (done < count){
+        size_t blocks = count - done;
+        if (blocks > CHUNK_MAX / 2 / stride){
+            blocks = CHUNK_MAX / 2 / stride;
+        }
+        size_t wanted = blocks * stride - mem_region_size;
+
+        struct mem_region *mem = find_free_region(&arena->heap, wanted);
+        if (mem == NULL){
+            mem = find_free_region(&arena->heap, size);
+        }
+        if (mem == NULL){
+            if (add_span(arena, wanted) && add_span(arena, size)){
+                break;
+            }
+            continue;
+        }
+        remove_free_region(&arena->heap, mem);
+        done += carve_region(&arena->heap, mem, size, count - done, out + done);
+    }
+    return done;
+}
+
+/*
+ * Free a region of arena. A span left empty goes back to the pool,
+ * unless it is the last ordinary span of the arena.
+ */
+static void arena_free(struct arena *arena, struct mem_region *region){
+    region = heap_free(&arena->heap, region);
+
+    struct mem_region *fence = next_region(region);
+    if (!is_fence(fence)){
+        return;
+    }
+    struct span *span = (struct span *)(fence + 1);
+    if ((uint8_t *)region != span->region->data){
+        return;
+    }
+    if (arena->spans == span && span->next == NULL
+            && region_size(span->region) <= SPAN_SIZE + SPLIT_THRESHOLD){
+        return;
+    }
+    remove_free_region(&arena->heap, region);
+    release_span(span);
+}
+
+/*
+ * Free the regions of arena from first to last, which lie one after the
+ * other, by joining them into a single region first.
+ */
+static void arena_free_run(struct arena *arena, struct mem_region *first, struct mem_region *last){
+    size_t size = region_size(first);
+    for (struct mem_region *region = first; region != last; ){
+        region = next_region(region);
+        track_region(&arena->heap, region, 0);
+        size += mem_region_size + region_size(region);
+        heap_stats.coalesces++;
+    }
+    set_region_size(first, size);
+    arena_free(arena, first);
+}
+
+// take a region filling a SLAB_SIZE-aligned page from arena
+static struct mem_region *arena_alloc_slab(struct arena *arena){
+    return arena_alloc_aligned(arena, SLAB_SIZE - mem_region_size, SLAB_SIZE, mem_region_size);
+}
+
+// resize a region of arena in place
+static int arena_resize(struct arena *arena, struct mem_region *region, size_t size){
+    return heap_resize(&arena->heap, region, size);
+}
+
+// object number of ptr in slab, -1 if ptr is not an object address
+static int slab_index(struct slab *slab, void *ptr){
+    if ((uint8_t *)ptr < slab->first){
+        return -1;
+    }
+    uint32_t offset = (uint8_t *)ptr - slab->first;
+    uint32_t index = ((uint64_t)offset * slab->reciprocal) >> 32;
+    if (index * slab->object_size != offset || index >= slab->objects){
+        return -1;
+    }
+    return (int)index;
+}
+
+// check if object index of slab is free, or about to be, from any thread
+static int slab_object_free(struct slab *slab, int index){
+    uint64_t bit = 1ULL << (index % 64);
+    return (atomic_load_explicit(&slab->free_map[index / 64], memory_order_acquire) & bit)
+            || (atomic_load(&slab->pending[index / 64]) & bit);
+}
+
+// size class of a slab
+static int slab_class(struct slab *slab){
+    return slab->object_size / 8 - 1;
+}
+
+// push slab on the slab list at head
+static void slab_list_push(struct slab **head, struct slab *slab){
+    slab->prev = NULL;
+    slab->next = *head;
+    if (slab->next != NULL){
+        slab->next->prev = slab;
+    }
+    *head = slab;
+}
+
+// take slab off the slab list at head
+static void slab_list_remove(struct slab **head, struct slab *slab){
+    if (slab->prev != NULL){
+        slab->prev->next = slab->next;
+    }
+    else{
+        *head = slab->next;
+    }
+    if (slab->next != NULL){
+        slab->next->prev = slab->prev;
+    }
+}
+
+// put slab on the list of its arena's slabs with free objects
+static void list_slab(struct slab *slab){
+    slab_list_push(&slab->arena->slabs[slab_class(slab)], slab);
+    slab->listed = 1;
+}
+
+// take slab off the list of its arena's slabs with free objects
+static void unlist_slab(struct slab *slab){
+    slab_list_remove(&slab->arena->slabs[slab_class(slab)], slab);
+    slab->listed = 0;
+}
+
+// set up a new slab for objects of class in arena, caller holds the lock
+static struct slab *create_slab(struct arena *arena, int class){
+    // the bookkeeping section starts the page, so slabs can follow each other
+    struct mem_region *region = engine->alloc_slab(arena);
+    if (region == NULL){
+        return NULL;
+    }
+    // the slab belongs to the arena, whichever process is current
+    region->pid = arena->pid;
+
+    // room for the two bitmaps of as many objects as fit without them
+    size_t object_size = (class + 1) * 8;
+    size_t room = SLAB_SIZE - mem_region_size - sizeof(struct slab);
+    uint32_t words = (room / object_size + 63) / 64;
+    room -= 2 * words * sizeof(uint64_t);
+
+    // the color comes out of the space the objects leave over
+    size_t color = class % SLAB_COLORS * SLAB_COLOR;
+    if (color > room % object_size){
+        color = room % object_size & ~(size_t)7;
+    }
+
+    struct slab *slab = (struct slab *)(region->data + color);
+    slab->arena = arena;
+    slab->listed = 0;
+    slab->owner = 0;
+    slab->object_size = object_size;
+    slab->objects = room / object_size;
+    slab->reciprocal = ((1ULL << 32) + slab->object_size - 1) / slab->object_size;
+    slab->used = 0;
+    slab->nonempty = 0;
+
+    slab->pending = &slab->free_map[words];
+    slab->first = (uint8_t *)&slab->free_map[2 * words];
+    for (uint32_t word = 0; word < words; word++){
+        uint32_t objects = slab->objects > word * 64 ? slab->objects - word * 64 : 0;
+        slab->free_map[word] = objects >= 64 ? ~0ULL : (1ULL << objects) - 1;
+        slab->pending[word] = 0;
+        if (objects > 0){
+            slab->nonempty |= 1U << word;
+        }
+    }
+
+    slab_pages[slab_page(slab)] = color / 8 + 1;
+    return slab;
+}
+
+// give an empty slab back to its arena, caller holds the lock
+static void release_slab(struct slab *slab){
+    size_t page = slab_page(slab);
+    slab_pages[page] = 0;
+    engine->free(slab->arena, (struct mem_region *)((uint8_t *)pool + page * SLAB_SIZE));
+}
+
+/*
+ * Take a free object of slab, which must have one. There are no
+ * data-dependent branches, so this costs the same wherever the object is.
+ * Other threads check objects in free_map (see slab_object_free), but
+ * only the thread owning the slab, or holding the lock if none does,
+ * changes it, so plain atomic loads and stores keep it consistent.
+ */
+static void *slab_take(struct slab *slab){
+    uint32_t word = __builtin_ctz(slab->nonempty);
+    uint64_t map = atomic_load_explicit(&slab->free_map[word], memory_order_relaxed);
+    uint32_t bit = __builtin_ctzll(map);
+    map &= map - 1;
+    atomic_store_explicit(&slab->free_map[word], map, memory_order_release);
+    slab->nonempty &= ~((uint32_t)(map == 0) << word);
+    slab->used++;
+    return slab->first + (size_t)(word * 64 + bit) * slab->object_size;
+}
+
+// put object index back into slab
+static void slab_put(struct slab *slab, uint32_t index){
+    _Atomic uint64_t *map = &slab->free_map[index / 64];
+    atomic_store_explicit(map, atomic_load_explicit(map, memory_order_relaxed) | 1ULL << (index % 64),
+            memory_order_release);
+    slab->nonempty |= 1U << (index / 64);
+    slab->used--;
+}
+
+// allocate an object of class from the slabs of arena, caller holds the lock
+static void *slab_alloc(struct arena *arena, int class){
+    struct slab *slab = arena->slabs[class];
+    if (slab == NULL){
+        slab = create_slab(arena, class);
+        if (slab == NULL){
+            return NULL;
+        }
+        list_slab(slab);
+    }
+
+    void *object = slab_take(slab);
+    if (slab->used == slab->objects){
+        unlist_slab(slab);
+    }
+    return object;
+}
+
+/*
+ * List a slab no thread cache owns if it has free objects. An empty slab
+ * goes back to the arena, unless it is the only one of its size with room.
+ * Caller holds the lock.
+ */
+static void settle_slab(struct slab *slab){
+    if (slab->used < slab->objects && !slab->listed){
+        list_slab(slab);
+    }
+    if (slab->used == 0 && (slab->next != NULL || slab->prev != NULL)){
+        unlist_slab(slab);
+        release_slab(slab);
+    }
+}
+
+// free object index of a slab no thread cache owns, caller holds the lock
+static void slab_free(struct slab *slab, int index){
+    slab_put(slab, index);
+    settle_slab(slab);
+}
+
+// visit the objects of a slab, a run of free objects at once
+static void walk_slab(struct slab *slab, void (*visit)(uint32_t pid, int free, size_t size, void *addr)){
+    uint32_t pid = slab->arena->pid;
+    uint32_t index = 0;
+    while (index < slab->objects){
+        uint8_t *object = slab->first + (size_t)index * slab->object_size;
+        if (!slab_object_free(slab, index)){
+            visit(pid, 0, slab->object_size, object);
+            index++;
+            continue;
+        }
+        uint32_t run = index;
+        while (run < slab->objects && slab_object_free(slab, run)){
+            run++;
+        }
+        visit(pid, 1, (size_t)(run - index) * slab->object_size, object);
+        index = run;
+    }
+}
+
+/*
+ * Set up a new chunk of the pool as one free region closed by a fence.
+ * The fence closing the pool so far becomes the head of the region, which
+ * merges with a free region before it.
+ */
+static void free_list_add_chunk(struct mem_region *chunk, size_t size){
+    struct mem_region *fence = (struct mem_region *)((uint8_t *)chunk + size) - 1;
+    fence->free = 0;
+    set_region_size(fence, 0);
+    fence->pid = 0;
+    if (chunk != pool){
+        struct mem_region *head = chunk - 1;
+        set_region_size(head, size - mem_region_size);
+        heap_free(&pool_heap, head);
+        return;
+    }
+    chunk->prev_free = 0;
+    set_region_size(chunk, size - 2 * mem_region_size);
+    chunk->pid = 0;
+    mark_free(chunk);
+    insert_free_region(&pool_heap, chunk);
+}
+
+// bytes of the storage in use in the objects of slab
+static size_t slab_bytes_in_use(struct slab *slab){
+    // objects freed by another thread are pending until their owner takes them
+    size_t used = slab->used;
+    for (uint32_t word = 0; word < (slab->objects + 63) / 64; word++){
+        used -= __builtin_popcountll(slab->pending[word]);
+    }
+    return used * slab->object_size;
+}
+
+// bytes of the storage in use in the regions and slab objects of span
+static size_t span_bytes_in_use(struct span *span){
+    size_t bytes = 0;
+    struct mem_region *inner = (struct mem_region *)span->region->data;
+    for (; !is_fence(inner); inner = next_region(inner)){
+        if (inner->free){
+            continue;
+        }
+        if (!is_slab_object(inner->data)){
+            bytes += region_size(inner);
+            continue;
+        }
+        bytes += slab_bytes_in_use(slab_of(inner->data));
+    }
+    return bytes;
+}
+
+// give every span of arena back to the pool, return the bytes that were in use
+static size_t free_list_free_all(struct arena *arena){
+    size_t bytes = 0;
+    while (arena->spans != NULL){
+        bytes += span_bytes_in_use(arena->spans);
+        release_span(arena->spans);
+    }
+    memset(&arena->heap, 0, sizeof(arena->heap));
+    memset(arena->slabs, 0, sizeof(arena->slabs));
+    return bytes;
+}
+
+// visit a region
+static void visit_region(struct mem_region *region, void (*visit)(uint32_t pid, int free, size_t size, void *addr)){
+    visit(region->pid, region->free, region_size(region), region->data);
+}
+
+/*
+ * Visit every region of the pool. Spans are visited as the regions
+ * inside them, and slabs as their objects.
+ */
+static void free_list_walk(void (*visit)(uint32_t pid, int free, size_t size, void *addr)){
+    uint8_t *end = (uint8_t *)pool + pool_size;
+    for (struct mem_region *head = pool; (uint8_t *)head < end; head = next_region(head)){
+        // the fence closing a chunk is followed by the next chunk
+        if (is_fence(head)){
+            continue;
+        }
+        if (head->free){
+            visit_region(head, visit);
+        }
+        else{
+            struct mem_region *inner = (struct mem_region *)head->data;
+            while (!is_fence(inner)){
+                if (!inner->free && is_slab_object(inner->data)){
+                    walk_slab(slab_of(inner->data), visit);
+                }
+                else{
+                    visit_region(inner, visit);
+                }
+                inner = next_region(inner);
+            }
+        }
+    }
+}
+
+/*
+ * Binary buddy engine. Every chunk of the pool is one block of
+ * 2^buddy_max_order bytes (the chunk size is a power of two), split in halves until a block just fits a request; a freed block
+ * merges with its buddy (the other half it was split from) for as long
+ * as that one is free too. Blocks use the same bookkeeping section as
+ * regions, with size covering the rest of the block.
+ * Free blocks of each order have a size class of their own, so they are
+ * kept in the free lists of buddy_heap. All processes share the pool.
+ * Small sizes come from slabs, each of them a block of SLAB_SIZE bytes,
+ * which starts a SLAB_SIZE-aligned page as every block of its order does.
+ * An aligned region lies inside a block at least as large as its
+ * alignment, with its bookkeeping section in the padding in front of it.
+ * Both have prev_free set, which blocks do not use otherwise: the word
+ * in front of the region leads back to the block like a footer, and the
+ * first word of the block's data holds the offset of the region. Only
+ * the region is marked in the side table, so it is the one to be freed.
+ */
+#define BUDDY_MIN_ORDER 5 // 32 bytes: bookkeeping section and free list links
+
+static struct heap buddy_heap;
+static int buddy_max_order; // a whole chunk
+
+// data size of a block of order
+static size_t buddy_size(int order){
+    return ((size_t)1 << order) - mem_region_size;
+}
+
+// order of the smallest block holding size bytes of data
+static int buddy_order(size_t size){
+    int order = 64 - __builtin_clzl(size + mem_region_size - 1);
+    return order < BUDDY_MIN_ORDER ? BUDDY_MIN_ORDER : order;
+}
+
+// the block block of order was split from together with
+static struct mem_region *buddy_of(struct mem_region *block, int order){
+    size_t offset = (uint8_t *)block - (uint8_t *)pool;
+    return (struct mem_region *)((uint8_t *)pool + (offset ^ ((size_t)1 << order)));
+}
+
+// set up a new chunk of the pool as a single free block
+static void buddy_add_chunk(struct mem_region *chunk, size_t size){
+    chunk->prev_free = 0;
+    set_region_size(chunk, buddy_size(buddy_max_order));
+    chunk->pid = 0;
+    chunk->free = 1;
+    set_region_start(chunk, 1);
+    insert_free_region(&buddy_heap, chunk);
+}
+
+// allocate the smallest block holding size bytes, splitting larger ones
+static struct mem_region *buddy_alloc(struct arena *arena, size_t size){
+    int order = buddy_order(size);
+    if (order > buddy_max_order){
+        return NULL;
+    }
+    int class = next_nonempty_class(&buddy_heap, size_class(buddy_size(order)));
+    if (class < 0 && grow_pool(chunk_size) == 0){
+        class = next_nonempty_class(&buddy_heap, size_class(buddy_size(order)));
+    }
+    if (class < 0){
+        return NULL;
+    }
+
+    struct mem_region *block = buddy_heap.free_lists[class];
+    remove_free_region(&buddy_heap, block);
+    heap_stats.searches++;
+    heap_stats.scanned++;
+    zero_pages = region_size(block) >= RELEASE_MIN;
+    for (int split = buddy_order(region_size(block)); split > order; split--){
+        struct mem_region *upper = buddy_of(block, split - 1);
+        upper->prev_free = 0;
+        set_region_size(upper, buddy_size(split - 1));
+        upper->pid = 0;
+        upper->free = 1;
+        set_region_start(upper, 1);
+        insert_free_region(&buddy_heap, upper);
+        set_region_size(block, region_size(upper));
+        heap_stats.splits++;
+    }
+
+    block->free = 0;
+    block->pid = getCurrentPID();
+    return block;
+}
+
+/*
+ * Free a block, merging it with its buddy as long as that one is free.
+ * Return the merged block.
+ */
+static struct mem_region *buddy_merge(struct mem_region *block){
+
+    // pages that may have been touched since they were last released
+    uint8_t *dirty_begin = (uint8_t *)block;
+    uint8_t *dirty_end = block->data + region_size(block);
+    for (int order = buddy_order(region_size(block)); order < buddy_max_order; order++){
+        struct mem_region *buddy = buddy_of(block, order);
+        if (!buddy->free || region_size(buddy) != region_size(block)){
+            break;
+        }
+        remove_free_region(&buddy_heap, buddy);
+        // a large buddy kept the pages of its links and last bytes
+        if (buddy < block){
+            dirty_begin = region_size(buddy) < RELEASE_MIN ? (uint8_t *)buddy : (uint8_t *)block - sizeof(size_t);
+        }
+        else{
+            dirty_end = region_size(buddy) < RELEASE_MIN ? buddy->data + region_size(buddy) : buddy->data + FREE_LINKS_SIZE;
+        }
+        if (buddy < block){
+            set_region_start(block, 0);
+            block = buddy;
+        }
+        else{
+            set_region_start(buddy, 0);
+        }
+        set_region_size(block, buddy_size(order + 1));
+        heap_stats.coalesces++;
+    }
+    block->free = 1;
+    insert_free_region(&buddy_heap, block);
+    if (region_size(block) >= RELEASE_MIN){
+        release_pages(block, dirty_begin, dirty_end);
+    }
+    return block;
+}
+
+// take a block of SLAB_SIZE bytes, which starts a SLAB_SIZE-aligned page
+static struct mem_region *buddy_alloc_slab(struct arena *arena){
+    return buddy_alloc(arena, SLAB_SIZE - mem_region_size);
+}
+
+// allocate count blocks of size bytes into out, return how many were allocated
+static size_t buddy_alloc_batch(struct arena *arena, size_t size, size_t count, void **out){
+    for (size_t i = 0; i < count; i++){
+        struct mem_region *block = buddy_alloc(arena, size);
+        if (block == NULL){
+            return i;
+        }
+        out[i] = block->data;
+    }
+    return count;
+}
+
+// take a block holding an aligned region of size bytes, see buddy_alloc_aligned
+static struct mem_region *buddy_alloc_aligned(struct arena *arena, size_t size, size_t align, size_t offset){
+    // the data starts past the offset and the back link, at least 32 bytes in
+    size_t pad = ((32 - offset + align - 1) & ~(align - 1)) + offset;
+    // blocks at least align bytes large start on a multiple of it
+    size_t need = pad + size > align ? pad + size : align;
+    struct mem_region *block = buddy_alloc(arena, need - mem_region_size);
+    if (block == NULL){
+        return NULL;
+    }
+
+    struct mem_region *region = (struct mem_region *)((uint8_t *)block + pad) - 1;
+    set_region_size(region, block->data + region_size(block) - region->data);
+    region->free = 0;
+    region->prev_free = 1;
+    region->pid = block->pid;
+    *((size_t *)region - 1) = (uint8_t *)region - block->data;
+    block->prev_free = 1;
+    *(size_t *)block->data = (uint8_t *)region - (uint8_t *)block;
+    set_region_start(block, 0);
+    set_region_start(region, 1);
+    return region;
+}
+
+// block region lies in, which is region itself unless it is aligned
+static struct mem_region *buddy_block_of(struct mem_region *region){
+    if (!region->prev_free){
+        return region;
+    }
+    struct mem_region *block = prev_region(region);
+    block->prev_free = 0;
+    set_region_start(region, 0);
+    set_region_start(block, 1);
+    return block;
+}
+
+static void buddy_free(struct arena *arena, struct mem_region *block){
+    buddy_merge(buddy_block_of(block));
+}
+
+// free the blocks from first to last, which lie one after the other
+static void buddy_free_run(struct arena *arena, struct mem_region *first, struct mem_region *last){
+    while (1){
+        struct mem_region *next = next_region(first);
+        buddy_merge(buddy_block_of(first));
+        if (first == last){
+            return;
+        }
+        first = next;
+    }
+}
+
+/*
+ * Resize a block in place to hold size bytes, by splitting off upper
+ * halves or by taking in free upper buddies.
+ * Return 0 if succeed, return 1 if a buddy it needs is not free.
+ */
+static int buddy_resize(struct arena *arena, struct mem_region *block, size_t size){
+    // an aligned region would lose its alignment
+    if (block->prev_free){
+        return 1;
+    }
+    int order = buddy_order(size);
+    int current = buddy_order(region_size(block));
+    for (int grow = current; grow < order; grow++){
+        if (grow >= buddy_max_order){
+            return 1;
+        }
+        struct mem_region *buddy = buddy_of(block, grow);
+        if (buddy < block || !buddy->free || region_size(buddy) != buddy_size(grow)){
+            return 1;
+        }
+    }
+
+    for (; current < order; current++){
+        struct mem_region *buddy = buddy_of(block, current);
+        remove_free_region(&buddy_heap, buddy);
+        set_region_start(buddy, 0);
+        set_region_size(block, buddy_size(current + 1));
+        heap_stats.coalesces++;
+    }
+    for (; current > order; current--){
+        // the upper half cannot merge, its buddy is block
+        struct mem_region *upper = buddy_of(block, current - 1);
+        upper->free = 0;
+        upper->prev_free = 0;
+        set_region_size(upper, buddy_size(current - 1));
+        upper->pid = block->pid;
+        set_region_start(upper, 1);
+        set_region_size(block, region_size(upper));
+        heap_stats.splits++;
+        buddy_merge(upper);
+    }
+    return 0;
+}
+
+// free every block of the arena's process in one sweep over the pool,
+// return the bytes that were in use
+static size_t buddy_free_all(struct arena *arena){
+    size_t bytes = 0;
+    uint8_t *end = (uint8_t *)pool + pool_size;
+    struct mem_region *block = pool;
+    while ((uint8_t *)block < end){
+        // a merged block starts at or before block, and ends after it
+        if (!block->free && block->pid == arena->pid){
+            if (is_slab_object(block->data)){
+                bytes += slab_bytes_in_use(slab_of(block->data));
+                slab_pages[slab_page(block->data)] = 0;
+            }
+            else if (block->prev_free){
+                struct mem_region *region = (struct mem_region *)((uint8_t *)block + *(size_t *)block->data);
+                bytes += region_size(region);
+                block = buddy_block_of(region);
+            }
+            else{
+                bytes += region_size(block);
+            }
+            block = buddy_merge(block);
+        }
+        block = next_region(block);
+    }
+    memset(arena->slabs, 0, sizeof(arena->slabs));
+    return bytes;
+}
+
+// visit every block in address order
+static void buddy_walk(void (*visit)(uint32_t pid, int free, size_t size, void *addr)){
+    uint8_t *end = (uint8_t *)pool + pool_size;
+    for (struct mem_region *block = pool; (uint8_t *)block < end; block = next_region(block)){
+        if (!block->free && is_slab_object(block->data)){
+            walk_slab(slab_of(block->data), visit);
+        }
+        else{
+            visit_region(block, visit);
+        }
+    }
+}
+
+static const struct engine_ops free_list_engine = {
+    free_list_add_chunk, arena_alloc, arena_alloc_batch, arena_free, arena_free_run,
+    free_list_free_all, arena_resize, arena_alloc_aligned, free_list_walk, arena_alloc_slab
+};
+
+static const struct engine_ops buddy_engine = {
+    buddy_add_chunk, buddy_alloc, buddy_alloc_batch, buddy_free, buddy_free_run,
+    buddy_free_all, buddy_resize, buddy_alloc_aligned, buddy_walk, buddy_alloc_slab
+};
+
+static const struct engine_ops *engine = &free_list_engine;
+
+/*
+ * Map another chunk of at least size bytes at the end of the pool, in
+ * multiples of chunk_size, and hand it to the engine. Near the limit the
+ * free list engine maps whatever room is left, as the chunk merges with a
+ * free region at the end of the pool, which may make up for the rest.
+ * Return 0 if succeed, return 1 if the pool has reached its limit.
+ */
+static int grow_pool(size_t size){
+    size_t grow = (size + chunk_size - 1) / chunk_size * chunk_size;
+    size_t room = pool_limit - pool_size;
+    if (grow > room && engine != &buddy_engine){
+        grow = room;
+    }
+    if (grow == 0 || grow > CHUNK_MAX || grow > room){
+        return 1;
+    }
+    struct mem_region *chunk = (struct mem_region *)((uint8_t *)pool + pool_size);
+    if (mprotect(chunk, grow, PROT_READ | PROT_WRITE)){
+        return 1;
+    }
+    engine->add_chunk(chunk, grow);
+    pool_size += grow;
+    return 0;
+}
+
+/*
+ * PCBs are kept in an open addressing hash table keyed by PID,
+ * so a PID is turned into its PCB in constant time.
+ */
+static struct pcb **pcb_table = NULL;
+static size_t pcb_table_size = 0; // always a power of two
+static size_t pcb_count = 0;
+
+// home slot of pid in the PCB table
+static size_t pcb_slot(uint32_t pid){
+    return (pid * 2654435761u) & (pcb_table_size - 1);
+}
+
+// slot of the PCB of pid in the PCB table, pcb_table_size if there is none
+static size_t find_pcb_slot(uint32_t pid){
+    if (pcb_table == NULL){
+        return pcb_table_size;
+    }
+    for (size_t i = pcb_slot(pid); pcb_table[i] != NULL; i = (i + 1) & (pcb_table_size - 1)){
+        if (pcb_table[i]->pid == pid){
+            return i;
+        }
+    }
+    return pcb_table_size;
+}
+
+// PCB of pid, NULL if there is none
+static struct pcb *find_pcb(uint32_t pid){
+    size_t i = find_pcb_slot(pid);
+    return i < pcb_table_size ? pcb_table[i] : NULL;
+}
+
+// put pcb in the PCB table, growing it if it gets half full
+static int insert_pcb(struct pcb *pcb){
+    if ((pcb_count + 1) * 2 > pcb_table_size){
+        size_t old_size = pcb_table_size;
+        struct pcb **old_table = pcb_table;
+        size_t new_size = old_size ? old_size * 2 : 16;
+        struct pcb **new_table = map_zeroed(new_size * sizeof(struct pcb *));
+        if (new_table == NULL){
+            return 1;
+        }
+        pcb_table = new_table;
+        pcb_table_size = new_size;
+        for (size_t i = 0; i < old_size; i++){
+            if (old_table[i] != NULL){
+                size_t j = pcb_slot(old_table[i]->pid);
+                while (pcb_table[j] != NULL){
+                    j = (j + 1) & (pcb_table_size - 1);
+                }
+                pcb_table[j] = old_table[i];
+            }
+        }
+        unmap_zeroed(old_table, old_size * sizeof(struct pcb *));
+    }
+
+    size_t i = pcb_slot(pcb->pid);
+    while (pcb_table[i] != NULL){
+        i = (i + 1) & (pcb_table_size - 1);
+    }
+    pcb_table[i] = pcb;
+    pcb_count++;
+    return 0;
+}
+
+// create the PCB and the (empty) arena of a new process
+static struct pcb *create_pcb(uint32_t pid){
+    struct process *process = map_zeroed(sizeof(struct process));
+    if (process == NULL){
+        fprintf(stderr, "Error: Memory allocation for pcb failed.\n");
+        return NULL;
+    }
+    process->pcb.pid = pid;
+    process->pcb.arena = &process->arena;
+    process->arena.pid = pid;
+
+    if (insert_pcb(&process->pcb)){
+        fprintf(stderr, "Error: Memory allocation for pcb table failed.\n");
+        unmap_zeroed(process, sizeof(struct process));
+        return NULL;
+    }
+    return &process->pcb;
+}
+
+/*
+ * Multithreaded mode. The engine forms a central heap guarded by
+ * heap_lock, and every thread gets a cache of slabs that serves most
+ * myMalloc and myFree calls of small sizes without the lock. The cache
+ * owns the slabs it takes small objects from, and keeps them until the
+ * thread exits, or they become empty. A cache only holds slabs of one
+ * arena; it gives them back when the thread allocates for another
+ * process, and drops them when the arena is emptied.
+ * Objects freed by another thread get their pending bit set and go on
+ * the remote_frees stack of the owner, which takes them back on its
+ * next myMalloc. Regions are allocated and freed under the lock.
+ */
+#define MAX_THREAD_CACHES 128
+
+struct thread_cache {
+    struct arena *arena; // arena the owned slabs belong to
+    unsigned generation; // generation of arena they were taken in
+    struct slab *slabs[SLAB_CLASSES]; // owned slabs with free objects
+    struct slab *owned_slabs; // every owned slab
+    _Atomic(void *) remote_frees; // slab objects freed by other threads
+    atomic_int active;
+    struct mem_stats stats; // of the calls the cache served
+};
+
+static int threaded = 0;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER; // see myStartTrace
+static pthread_key_t cache_key;
+static struct thread_cache thread_caches[MAX_THREAD_CACHES];
+
+// index of the calling thread's cache: 0 if not claimed yet, -1 if none left
+static __thread int cache_index = 0;
+
+static void lock_heap(){
+    if (threaded){
+        pthread_mutex_lock(&heap_lock);
+    }
+}
+
+static void unlock_heap(){
+    if (threaded){
+        pthread_mutex_unlock(&heap_lock);
+    }
+}
+
+// push slab object ptr on the remote_frees stack of cache
+static void push_remote_free(struct thread_cache *cache, void *ptr){
+    void *head = atomic_load(&cache->remote_frees);
+    do {
+        *(void **)ptr = head;
+    } while (!atomic_compare_exchange_weak(&cache->remote_frees, &head, ptr));
+}
+
+// clear the pending bit of object index of slab
+static void clear_pending(struct slab *slab, int index){
+    atomic_fetch_and(&slab->pending[index / 64], ~(1ULL << (index % 64)));
+}
+
+// put object index back into a slab owned by cache
+static void cache_slab_put(struct thread_cache *cache, struct slab *slab, int index){
+    if (slab->used == slab->objects){
+        slab_list_push(&cache->slabs[slab_class(slab)], slab);
+    }
+    slab_put(slab, index);
+}
+
+// make cache the owner of slab, caller holds the lock
+static void own_slab(struct thread_cache *cache, struct slab *slab){
+    slab->owner = cache_index;
+    slab->owned_prev = NULL;
+    slab->owned_next = cache->owned_slabs;
+    if (slab->owned_next != NULL){
+        slab->owned_next->owned_prev = slab;
+    }
+    cache->owned_slabs = slab;
+    slab_list_push(&cache->slabs[slab_class(slab)], slab);
+}
+
+// hand a slab owned by cache back to its arena, caller holds the lock
+static void disown_slab(struct thread_cache *cache, struct slab *slab){
+    if (slab->used < slab->objects){
+        slab_list_remove(&cache->slabs[slab_class(slab)], slab);
+    }
+    if (slab->owned_prev != NULL){
+        slab->owned_prev->owned_next = slab->owned_next;
+    }
+    else{
+        cache->owned_slabs = slab->owned_next;
+    }
+    if (slab->owned_next != NULL){
+        slab->owned_next->owned_prev = slab->owned_prev;
+    }
+    slab->owner = 0;
+    slab->listed = 0;
+    settle_slab(slab);
+}
+
+/*
+ * Hand an empty slab owned by cache back to its arena, unless the cache
+ * allocates from it next.
+ */
+static void trim_cache_slab(struct thread_cache *cache, struct slab *slab){
+    if (slab->used == 0 && slab != cache->slabs[slab_class(slab)]){
+        pthread_mutex_lock(&heap_lock);
+        disown_slab(cache, slab);
+        pthread_mutex_unlock(&heap_lock);
+    }
+}
+
+/*
+ * Free slab object ptr of any process to its slab. An object of a slab
+ * owned by another thread cache is passed on to it. Caller holds the lock.
+ */
+static void free_object(void *ptr){
+    struct slab *slab = slab_of(ptr);
+    int index = slab_index(slab, ptr);
+    int owner = slab->owner;
+    if (owner != 0 && owner != cache_index){
+        atomic_fetch_or(&slab->pending[index / 64], 1ULL << (index % 64));
+        push_remote_free(&thread_caches[owner], ptr);
+        return;
+    }
+    // clear the bit first, slab_free may release the slab
+    clear_pending(slab, index);
+    if (owner != 0){
+        cache_slab_put(&thread_caches[owner], slab, index);
+    }
+    else{
+        slab_free(slab, index);
+    }
+}
+
+// free a remote_frees list of any process, caller holds the lock
+static void free_remote_list(void *ptr){
+    while (ptr != NULL){
+        void *next = *(void **)ptr;
+        free_object(ptr);
+        ptr = next;
+    }
+}
+
+/*
+ * Give up the slabs of cache. They go back to their arena, or are simply
+ * forgotten if the arena has been emptied since the cache took them.
+ * Caller holds the lock.
+ */
+static void flush_thread_cache(struct thread_cache *cache){
+    if (cache->arena == NULL || cache->generation != cache->arena->generation){
+        memset(cache->slabs, 0, sizeof(cache->slabs));
+        cache->owned_slabs = NULL;
+    }
+    while (cache->owned_slabs != NULL){
+        disown_slab(cache, cache->owned_slabs);
+    }
+}
+
+// make cache hold slabs of arena
+static void use_arena(struct thread_cache *cache, struct arena *arena){
+    if (cache->arena != arena || cache->generation != arena->generation){
+        pthread_mutex_lock(&heap_lock);
+        flush_thread_cache(cache);
+        cache->arena = arena;
+        cache->generation = arena->generation;
+        pthread_mutex_unlock(&heap_lock);
+    }
+}
+
+// take back object ptr, freed by another thread, if its slab is still owned by cache
+static int take_remote_free(struct thread_cache *cache, void *ptr){
+    struct slab *slab = slab_of(ptr);
+    if (slab->owner != cache_index){
+        return 0;
+    }
+    int index = slab_index(slab, ptr);
+    cache_slab_put(cache, slab, index);
+    clear_pending(slab, index);
+    trim_cache_slab(cache, slab);
+    return 1;
+}
+
+/*
+ * Take back what other threads freed into the slabs the cache owns.
+ * Objects of slabs given up since are freed for good.
+ */
+static void drain_remote_frees(struct thread_cache *cache){
+    void *ptr = atomic_exchange(&cache->remote_frees, NULL);
+    void *foreign = NULL;
+    while (ptr != NULL){
+        void *next = *(void **)ptr;
+        if (!take_remote_free(cache, ptr)){
+            *(void **)ptr = foreign;
+            foreign = ptr;
+        }
+        ptr = next;
+    }
+    if (foreign != NULL){
+        pthread_mutex_lock(&heap_lock);
+        free_remote_list(foreign);
+        pthread_mutex_unlock(&heap_lock);
+    }
+}
+
+// return every owned slab of an exiting thread to the central heap
+static void release_thread_cache(void *arg){
+    struct thread_cache *cache = arg;
+    pthread_mutex_lock(&heap_lock);
+    free_remote_list(atomic_exchange(&cache->remote_frees, NULL));
+    flush_thread_cache(cache);
+    cache->arena = NULL;
+    cache->active = 0;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// forget remote frees of pid in every cache, caller holds the lock
+static void purge_remote_frees(uint32_t pid){
+    for (int i = 1; i < MAX_THREAD_CACHES; i++){
+        void *ptr = atomic_exchange(&thread_caches[i].remote_frees, NULL);
+        while (ptr != NULL){
+            void *next = *(void **)ptr;
+            if (slab_of(ptr)->arena->pid != pid){
+                push_remote_free(&thread_caches[i], ptr);
+            }
+            ptr = next;
+        }
+    }
+}
+
+// cache of the calling thread, claiming one on first use
+static struct thread_cache *my_thread_cache(){
+    if (cache_index > 0){
+        return &thread_caches[cache_index];
+    }
+    if (cache_index < 0){
+        return NULL;
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    cache_index = -1;
+    for (int i = 1; i < MAX_THREAD_CACHES; i++){
+        if (!thread_caches[i].active){
+            thread_caches[i].active = 1;
+            cache_index = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+
+    if (cache_index < 0){
+        return NULL;
+    }
+    pthread_setspecific(cache_key, &thread_caches[cache_index]);
+    return &thread_caches[cache_index];
+}
+
+/*
+ * Calls served under the heap lock are counted in heap_stats, the rest
+ * by the calling thread's cache. Storage freed by another thread than
+ * the one that allocated it makes the bytes_in_use of a cache wrap
+ * around, so only the sum means anything. Storage handed out under the
+ * lock is freed under it too, so the bytes of heap_stats never exceed
+ * the sum, and the peak is checked on them.
+ * myMemoryStats reads the counters of the caches while their threads
+ * update them, so they are accessed atomically. Each has a single
+ * writer, so a relaxed load and store do without a locked add.
+ */
+static void add_count(uint64_t *counter, uint64_t n){
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static struct mem_stats *lock_stats(){
+    if (threaded){
+        struct thread_cache *cache = my_thread_cache();
+        if (cache != NULL){
+            return &cache->stats;
+        }
+    }
+    lock_heap();
+    return &heap_stats;
+}
+
+static void update_peak(){
+    if ((int64_t)heap_stats.bytes_in_use > (int64_t)heap_stats.peak_bytes_in_use){
+        heap_stats.peak_bytes_in_use = heap_stats.bytes_in_use;
+    }
+}
+
+static void unlock_stats(struct mem_stats *stats){
+    if (stats == &heap_stats){
+        update_peak();
+        unlock_heap();
+    }
+}
+
+static void count_free(struct mem_stats *stats, size_t bytes){
+    add_count(&stats->frees, 1);
+    add_count(&stats->bytes_in_use, -(uint64_t)bytes);
+}
+
+// count a free of bytes of storage that did not take the lock
+static void count_unlocked_free(size_t bytes){
+    struct mem_stats *stats = lock_stats();
+    count_free(stats, bytes);
+    unlock_stats(stats);
+}
+
+/*
+ * Take an object of class from the slabs cache owns. Only when none of
+ * them has room, the cache takes over a slab of the arena under the lock.
+ */
+static void *cache_slab_alloc(struct thread_cache *cache, int class){
+    use_arena(cache, currentPCB->arena);
+    if (cache->slabs[class] == NULL && atomic_load(&cache->remote_frees) != NULL){
+        drain_remote_frees(cache);
+    }
+
+    struct slab *slab = cache->slabs[class];
+    if (slab == NULL){
+        pthread_mutex_lock(&heap_lock);
+        slab = cache->arena->slabs[class];
+        if (slab != NULL){
+            unlist_slab(slab);
+        }
+        else{
+            slab = create_slab(cache->arena, class);
+        }
+        if (slab != NULL){
+            own_slab(cache, slab);
+        }
+        pthread_mutex_unlock(&heap_lock);
+        if (slab == NULL){
+            return NULL;
+        }
+    }
+
+    void *object = slab_take(slab);
+    if (slab->used == slab->objects){
+        slab_list_remove(&cache->slabs[class], slab);
+    }
+    return object;
+}
+
+/*
+ * Free object index of slab, which is at ptr. Its owner takes it back
+ * without the lock, other threads pass it on to the owner.
+ * Return 3 if another thread has just freed it, 1 otherwise.
+ */
+static int free_slab_object(struct slab *slab, int index, void *ptr){
+    if (threaded){
+        int owner = slab->owner;
+        if (owner != 0 && owner == cache_index){
+            struct thread_cache *cache = &thread_caches[owner];
+            count_free(&cache->stats, slab->object_size);
+            cache_slab_put(cache, slab, index);
+            trim_cache_slab(cache, slab);
+            return 1;
+        }
+        if (owner != 0){
+            uint64_t bit = 1ULL << (index % 64);
+            if (atomic_fetch_or(&slab->pending[index / 64], bit) & bit){
+                return 3;
+            }
+            count_unlocked_free(slab->object_size);
+            push_remote_free(&thread_caches[owner], ptr);
+            return 1;
+        }
+    }
+
+    lock_heap();
+    count_free(&heap_stats, slab->object_size);
+    free_object(ptr);
+    unlock_heap();
+    return 1;
+}
+
+/*
+ * A child forked while another thread holds a lock would find it held
+ * forever, so fork takes them first. Slabs owned by the caches of the
+ * other threads stay owned in the child.
+ */
+static void lock_for_fork(){
+    pthread_mutex_lock(&trace_lock);
+    pthread_mutex_lock(&heap_lock);
+}
+
+static void unlock_after_fork(){
+    pthread_mutex_unlock(&heap_lock);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Switch to multithreaded mode, after which myMalloc, myFree and
+ * memoryMap may be called from any thread. It cannot be switched back.
+ * Return 0 if succeed, return 1 if fail.
+ */
+int myEnableMultithreading(){
+    if (pool == NULL){
+        fprintf(stderr, "Error: Memory pool is not initialized.\n");
+        return 1;
+    }
+    if (!threaded){
+        if (pthread_key_create(&cache_key, release_thread_cache)
+                || pthread_atfork(lock_for_fork, unlock_after_fork, unlock_after_fork)){
+            fprintf(stderr, "Error: Setting up multithreaded mode failed.\n");
+            return 1;
+        }
+        threaded = 1;
+    }
+    return 0;
+}
+
+// give the pool and its side tables back to the OS
+static void unmap_pool(){
+    munmap(pool, pool_limit);
+    unmap_zeroed(region_starts, pool_limit / 8 / 8);
+    unmap_zeroed(slab_pages, (pool_limit + SLAB_SIZE - 1) / SLAB_SIZE);
+    pool = NULL;
+    pool_size = 0;
+    region_starts = NULL;
+    slab_pages = NULL;
+    memset(&pool_heap, 0, sizeof(pool_heap));
+    memset(&buddy_heap, 0, sizeof(buddy_heap));
+}
+
+/*
+ * Initialize memory pool and currentPC, with the pool managed by the
+ * engine chosen in config, and sized as it asks for. A NULL config
+ * picks the free list engine and a POOL_SIZE pool growing up to
+ * POOL_MAX_SIZE. Nothing changes if the pool is already set up.
+ * Return 1 if config asks for what cannot be done, such as a placement
+ * policy other than MEM_POLICY_GOOD_FIT for the buddy engine.
+ */
+int myInitializeMemoryConfig(const struct mem_config *config){
+    // set up a single PCB if havn't
+    if (currentPCB == NULL){
+        currentPCB = create_pcb(0);
+
+        // check if malloc was successful
+        if (currentPCB == NULL){
+            return 1;
+        }
+    }
+
+    if (pool == NULL){
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        engine = &free_list_engine;
+        if (config != NULL && config->engine == MEM_ENGINE_BUDDY){
+            engine = &buddy_engine;
+        }
+        placement = MEM_POLICY_GOOD_FIT;
+        if (config != NULL){
+            if (config->policy > MEM_POLICY_TREE_FIT){
+                fprintf(stderr, "Error: Unknown placement policy.\n");
+                return 1;
+            }
+            // like mySetPlacementPolicy, the buddy engine takes no policy
+            if (engine == &buddy_engine && config->policy != MEM_POLICY_GOOD_FIT){
+                fprintf(stderr, "Error: The buddy engine has no placement policies.\n");
+                return 1;
+            }
+            placement = config->policy;
+        }
+
+        size_t size = POOL_SIZE;
+        size_t limit = POOL_MAX_SIZE;
+        if (config != NULL && config->pool_size != 0){
+            size = config->pool_size;
+        }
+        if (config != NULL && config->max_pool_size != 0){
+            limit = config->max_pool_size;
+        }
+        if (size > POOL_LIMIT_MAX || limit > POOL_LIMIT_MAX){
+            fprintf(stderr, "Error: Pool size is larger than %zu.\n", POOL_LIMIT_MAX);
+            return 1;
+        }
+
+        // chunks of the buddy engine are a power of two, others whole pages
+        if (size < POOL_MIN_SIZE){
+            size = POOL_MIN_SIZE;
+        }
+        if (engine == &buddy_engine){
+            size = (size_t)1 << (64 - __builtin_clzl(size - 1));
+        }
+        else{
+            size = (size + page_size - 1) & ~(page_size - 1);
+        }
+        chunk_size = size < CHUNK_MAX ? size : CHUNK_MAX;
+        size = (size + chunk_size - 1) / chunk_size * chunk_size;
+        limit = (limit + page_size - 1) & ~(page_size - 1);
+        if (limit < size){
+            limit = size;
+        }
+        buddy_max_order = __builtin_ctzl(chunk_size);
+
+        // reserve the pool up to its limit, chunks are mapped in as it grows
+        // and their pages are committed on first touch
+        void *mapping = mmap(NULL, limit, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        // Check if mmap was successful
+        if (mapping == MAP_FAILED){
+            fprintf(stderr, "Error: Memory allocation for pool failed.\n");
+            return 1;
+        }
+        pool = (struct mem_region *)mapping;
+        pool_limit = limit;
+
+        // One bit for every 8 bytes of the pool, and a byte for every slab page
+        region_starts = map_zeroed(limit / 8 / 8);
+        slab_pages = map_zeroed((limit + SLAB_SIZE - 1) / SLAB_SIZE);
+        if (region_starts == NULL || slab_pages == NULL){
+            fprintf(stderr, "Error: Memory allocation for pool side table failed.\n");
+            unmap_pool();
+            return 1;
+        }
+
+        // Bookkeeping section of the pool
+        while (pool_size < size){
+            if (grow_pool(chunk_size)){
+                fprintf(stderr, "Error: Memory allocation for pool failed.\n");
+                unmap_pool();
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Initialize memory pool and currentPC
+int myInitializeMemory(){
+    return myInitializeMemoryConfig(NULL);
+}
+
+// put the free regions of heap past the exact classes in its tree
+static void build_tree(struct heap *heap){
+    heap->tree = NULL;
+    for (int class = EXACT_CLASSES; class < NUM_CLASSES; class++){
+        for (struct mem_region *region = heap->free_lists[class]; region != NULL;
+                region = links_of(region)->next){
+            heap->tree = tree_insert(heap->tree, region);
+        }
+    }
+}
+
+/*
+ * mySetPlacementPolicy switches the policy by which the free list engine
+ * picks a free region for the allocations that follow, see enum
+ * mem_policy. Return 0 if succeed, return 1 if the pool is not set up,
+ * the policy is unknown, or the pool uses the buddy engine, which has no
+ * choice of region.
+ */
+int mySetPlacementPolicy(enum mem_policy policy){
+    if (pool == NULL || engine != &free_list_engine || policy > MEM_POLICY_TREE_FIT){
+        return 1;
+    }
+    lock_heap();
+    // the trees are not kept under the other policies
+    if (policy == MEM_POLICY_TREE_FIT && placement != MEM_POLICY_TREE_FIT){
+        build_tree(&pool_heap);
+        for (size_t slot = 0; slot < pcb_table_size; slot++){
+            if (pcb_table[slot] != NULL){
+                build_tree(&pcb_table[slot]->arena->heap);
+            }
+        }
+    }
+    placement = policy;
+    unlock_heap();
+    return 0;
+}
+
+/*
+ * myTeardownMemory gives the pool and every PCB back to the OS, after
+ * which myInitializeMemory may set them up again, and ends the trace
+ * being recorded. No other thread may use the allocator during or after
+ * the call.
+ */
+void myTeardownMemory(){
+    myStopTrace();
+    lock_heap();
+    for (int i = 1; i < MAX_THREAD_CACHES; i++){
+        struct thread_cache *cache = &thread_caches[i];
+        cache->arena = NULL;
+        memset(cache->slabs, 0, sizeof(cache->slabs));
+        cache->owned_slabs = NULL;
+        cache->remote_frees = NULL;
+        memset(&cache->stats, 0, sizeof(cache->stats));
+    }
+    memset(&heap_stats, 0, sizeof(heap_stats));
+
+    for (size_t i = 0; i < pcb_table_size; i++){
+        // the PCB is the first member of its process
+        unmap_zeroed(pcb_table[i], sizeof(struct process));
+    }
+    unmap_zeroed(pcb_table, pcb_table_size * sizeof(struct pcb *));
+    pcb_table = NULL;
+    pcb_table_size = 0;
+    pcb_count = 0;
+    currentPCB = NULL;
+
+    if (pool != NULL){
+        unmap_pool();
+    }
+    unlock_heap();
+}
+
+/*
+ * myCreatePCB creates the PCB of a new process with the given PID,
+ * which has to be unique and at most MAX_PID. It does not switch to it.
+ * It returns the new PCB, or a NULL pointer on failure.
+ */
+struct pcb *myCreatePCB(uint32_t pid){
+    if (pid > MAX_PID){
+        fprintf(stderr, "Error: PID %u is larger than %d.\n", pid, MAX_PID);
+        return NULL;
+    }
+
+    struct pcb *pcb = NULL;
+    lock_heap();
+    if (find_pcb(pid) != NULL){
+        fprintf(stderr, "Error: PID %u already exists.\n", pid);
+    }
+    else{
+        pcb = create_pcb(pid);
+    }
+    unlock_heap();
+    return pcb;
+}
+
+/*
+ * mySwitchPCB makes the process with the given PID the current process,
+ * so it owns what myMalloc allocates from now on.
+ * Return 0 if succeed, return 1 if there is no such process.
+ */
+int mySwitchPCB(uint32_t pid){
+    lock_heap();
+    struct pcb *pcb = find_pcb(pid);
+    if (pcb != NULL){
+        currentPCB = pcb;
+    }
+    unlock_heap();
+    return pcb == NULL;
+}
+
+/*
+ * Statistics. A call is counted where it is served, with the block size
+ * at hand, so the calls built on myMalloc and myFree count through them.
+ */
+
+// count a call asking for size bytes that got bytes of storage, 0 if it failed
+static void count_malloc(struct mem_stats *stats, size_t size, size_t bytes){
+    if (bytes == 0){
+        add_count(&stats->failed_mallocs, 1);
+        return;
+    }
+    add_count(&stats->mallocs, 1);
+    add_count(&stats->bytes_in_use, bytes);
+    add_count(&stats->sizes[63 - __builtin_clzl(size)], 1);
+    if (stats == &heap_stats){
+        update_peak();
+    }
+}
+
+// count a call that was refused before it got anywhere, return NULL
+static void *refuse_malloc(){
+    struct mem_stats *stats = lock_stats();
+    add_count(&stats->failed_mallocs, 1);
+    unlock_stats(stats);
+    return NULL;
+}
+
+// add the counters of a thread cache to total
+static void add_cache_stats(struct mem_stats *total, struct mem_stats *counts){
+    total->mallocs += __atomic_load_n(&counts->mallocs, __ATOMIC_RELAXED);
+    total->frees += __atomic_load_n(&counts->frees, __ATOMIC_RELAXED);
+    total->failed_mallocs += __atomic_load_n(&counts->failed_mallocs, __ATOMIC_RELAXED);
+    total->failed_frees += __atomic_load_n(&counts->failed_frees, __ATOMIC_RELAXED);
+    total->bytes_in_use += __atomic_load_n(&counts->bytes_in_use, __ATOMIC_RELAXED);
+    for (int i = 0; i < MEM_STATS_SIZES; i++){
+        total->sizes[i] += __atomic_load_n(&counts->sizes[i], __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * myMemoryStats fills in stats with the counters of the allocator since
+ * the pool was set up. They are read while the allocator keeps running,
+ * so in multithreaded mode they are only roughly a snapshot, and the peak
+ * may miss short spikes served by thread caches.
+ * Return 0 if succeed, return 1 if the pool is not initialized.
+ */
+int myMemoryStats(struct mem_stats *stats){
+    if (pool == NULL){
+        fprintf(stderr, "Error: Memory pool is not initialized.\n");
+        return 1;
+    }
+    lock_heap();
+    *stats = heap_stats;
+    for (int i = 1; i < MAX_THREAD_CACHES; i++){
+        add_cache_stats(stats, &thread_caches[i].stats);
+    }
+    if ((int64_t)stats->bytes_in_use > (int64_t)heap_stats.peak_bytes_in_use){
+        heap_stats.peak_bytes_in_use = stats->bytes_in_use;
+    }
+    stats->peak_bytes_in_use = heap_stats.peak_bytes_in_use;
+    unlock_heap();
+    return 0;
+}
+
+/*
+ * Tracing. While a trace is recorded, every call of myMalloc, myFree,
+ * myRealloc, myCalloc, myMallocAligned and myFreeAllForPID that changes
+ * the heap appends a trace_record to a buffer, which is written to the
+ * trace file whenever it fills up. The replay tool runs a trace against
+ * any engine. In multithreaded mode the calls are serialized while
+ * tracing, so the records keep the order the calls took effect in.
+ */
+#define TRACE_BUFFER 4096 // records written at once
+
+// changed under the trace lock; calls look at it without, then again under the lock
+static atomic_int tracing = 0;
+static int trace_fd = -1;
+static struct trace_record trace_buffer[TRACE_BUFFER];
+static int trace_count = 0;
+static uint64_t trace_time; // of the previous record, in nanoseconds
+
+static void lock_trace(){
+    if (threaded){
+        pthread_mutex_lock(&trace_lock);
+    }
+}
+
+static void unlock_trace(){
+    if (threaded){
+        pthread_mutex_unlock(&trace_lock);
+    }
+}
+
+static uint64_t trace_clock(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// write out the buffered records, return 0 if succeed
+static int flush_trace(){
+    uint8_t *next = (uint8_t *)trace_buffer;
+    size_t left = trace_count * sizeof(struct trace_record);
+    while (left > 0){
+        ssize_t written = write(trace_fd, next, left);
+        if (written < 0 && errno != EINTR){
+            return 1;
+        }
+        if (written > 0){
+            next += written;
+            left -= written;
+        }
+    }
+    trace_count = 0;
+    return 0;
+}
+
+// block id of ptr in the trace
+static uint64_t trace_id(void *ptr){
+    return ptr == NULL ? 0 : ((uint8_t *)ptr - (uint8_t *)pool) / 8;
+}
+
+// append a record, with the trace lock held
+static void trace_call(int op, uint32_t pid, size_t size, void *ptr, uint64_t arg){
+    // tracing may have stopped since the caller looked
+    if (!tracing){
+        return;
+    }
+    uint64_t now = trace_clock();
+    uint64_t delta = now - trace_time;
+    trace_time = now;
+
+    struct trace_record *record = &trace_buffer[trace_count++];
+    record->op = op;
+    record->pid = pid;
+    record->delta = delta < UINT32_MAX ? delta : UINT32_MAX;
+    record->size = size;
+    record->id = trace_id(ptr);
+    record->arg = arg;
+
+    if (trace_count == TRACE_BUFFER && flush_trace()){
+        fprintf(stderr, "Error: Writing the trace failed, tracing stopped.\n");
+        close(trace_fd);
+        trace_fd = -1;
+        tracing = 0;
+    }
+}
+
+/*
+ * myStartTrace starts recording a trace into the file at path, replacing
+ * it if it exists. The trace ends with myStopTrace or myTeardownMemory.
+ * Return 0 if succeed, return 1 if fail.
+ */
+int myStartTrace(const char *path){
+    if (pool == NULL){
+        fprintf(stderr, "Error: Memory pool is not initialized.\n");
+        return 1;
+    }
+    lock_trace();
+    if (tracing){
+        unlock_trace();
+        fprintf(stderr, "Error: A trace is already being recorded.\n");
+        return 1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct trace_header header = {TRACE_MAGIC, TRACE_VERSION};
+    if (fd < 0 || write(fd, &header, sizeof(header)) != sizeof(header)){
+        if (fd >= 0){
+            close(fd);
+        }
+        unlock_trace();
+        fprintf(stderr, "Error: Opening trace file %s failed.\n", path);
+        return 1;
+    }
+    trace_fd = fd;
+    trace_count = 0;
+    trace_time = trace_clock();
+    tracing = 1;
+    unlock_trace();
+    return 0;
+}
+
+/*
+ * myStopTrace writes out the rest of the trace and closes its file.
+ * Return 0 if succeed or no trace is recorded, return 1 if writing failed.
+ */
+int myStopTrace(){
+    lock_trace();
+    int failed = 0;
+    if (tracing){
+        failed = flush_trace();
+        failed |= close(trace_fd) != 0;
+        trace_fd = -1;
+        tracing = 0;
+    }
+    unlock_trace();
+    return failed;
+}
 
-// Initialize memory pool and currentPC
-int myInitializeMemory(){
-    // set up a single PCB if havn't
-    if (currentPCB == NULL){
-        currentPCB = malloc(sizeof(struct pcb));
+// myFreeAllForPID without tracing
+static int free_all_for_pid(uint32_t pid){
+    lock_heap();
+    struct pcb *pcb = find_pcb(pid);
+    if (pcb == NULL){
+        unlock_heap();
+        return 1;
+    }
 
-        // check if malloc was successful
-        if (currentPCB == NULL){
-            fprintf(stderr, "Error: Memory allocation for pcb failed.\n");
-            return 1;
-        }
+    struct arena *arena = pcb->arena;
+    if (threaded){
+        purge_remote_frees(pid);
+    }
+    // thread caches holding slabs of the arena will drop them
+    arena->generation++;
+    heap_stats.bytes_in_use -= engine->free_all(arena);
+    unlock_heap();
+    return 0;
+}
 
-        currentPCB->pid = 0;
+/*
+ * myFreeAllForPID deallocates every region owned by the process with
+ * the given PID at once, by giving all spans of its arena back to the
+ * pool. Pointers into them must not be used or freed afterwards.
+ * Return 0 if succeed, return 1 if there is no such process.
+ */
+int myFreeAllForPID(uint32_t pid){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    int failed = free_all_for_pid(pid);
+    if (traced){
+        if (!failed){
+            trace_call(TRACE_FREE_ALL, pid, 0, NULL, 0);
+        }
+        unlock_trace();
+    }
+    return failed;
+}
 
+// myMalloc without tracing, also used by the calls built on it
+static void *malloc_block(size_t size){
+    if (size == 0 || size > CHUNK_MAX){
+        return refuse_malloc();
     }
 
-    // allocate a 128MB memory pool if havn't
-    if (pool == NULL){
-        pool = (struct mem_region *)malloc(POOL_SIZE);
+    // round up size to 8-byte
+    size_t rounded = ((size + 7) / 8) * 8;
 
-        // Check if malloc was successful
-        if (pool == NULL){
-            fprintf(stderr, "Error: Memory allocation for pool failed.\n");
-            return 1;
+    // small objects come from slabs
+    if (rounded <= SLAB_MAX){
+        int class = rounded / 8 - 1;
+        if (threaded){
+            struct thread_cache *cache = my_thread_cache();
+            if (cache != NULL){
+                void *object = cache_slab_alloc(cache, class);
+                count_malloc(&cache->stats, size, object == NULL ? 0 : rounded);
+                return object;
+            }
         }
+        lock_heap();
+        void *object = slab_alloc(currentPCB->arena, class);
+        count_malloc(&heap_stats, size, object == NULL ? 0 : rounded);
+        unlock_heap();
+        return object;
+    }
 
-        // Bookkeeping section of the pool
-        pool->free = 1;
-        pool->size = POOL_SIZE - mem_region_size;
+    if (rounded < MIN_REGION_SIZE){
+        rounded = MIN_REGION_SIZE;
     }
-    return 0;
+
+    lock_heap();
+    struct mem_region *mem = engine->alloc(currentPCB->arena, rounded);
+    count_malloc(&heap_stats, size, mem == NULL ? 0 : region_size(mem));
+    unlock_heap();
+
+    // cannot find the appropriate block
+    if (mem == NULL){
+        return NULL;
+    }
+    return mem->data;
 }
 
 /*
@@ -56,49 +2650,234 @@ int myInitializeMemory(){
  * The pointer returned is always on an 8-byte boundary
  */
 void *myMalloc(size_t size){
-    if (size == 0){
-        return NULL;
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    void *ptr = malloc_block(size);
+    if (traced){
+        if (ptr != NULL){
+            trace_call(TRACE_MALLOC, getCurrentPID(), size, ptr, 0);
+        }
+        unlock_trace();
+    }
+    return ptr;
+}
+
+// myMallocAligned without tracing
+static void *malloc_aligned_block(size_t size, size_t alignment){
+    if (alignment == 0 || (alignment & (alignment - 1))){
+        return refuse_malloc();
+    }
+    if (alignment <= 8){
+        return malloc_block(size);
+    }
+    if (size == 0 || size > CHUNK_MAX - alignment){
+        return refuse_malloc();
     }
 
-    // bookkeeping section to be allocated
-    struct mem_region *mem;
-    
     // round up size to 8-byte
     size_t rounded = ((size + 7) / 8) * 8;
+    if (rounded < MIN_REGION_SIZE){
+        rounded = MIN_REGION_SIZE;
+    }
+    // aligned in the address space, not just within the pool
+    size_t offset = -(uintptr_t)pool & (alignment - 1);
+
+    lock_heap();
+    struct mem_region *mem = engine->alloc_aligned(currentPCB->arena, rounded, alignment, offset);
+    count_malloc(&heap_stats, size, mem == NULL ? 0 : region_size(mem));
+    unlock_heap();
+    return mem == NULL ? NULL : mem->data;
+}
+
+/*
+ * myMallocAligned allocates size bytes like myMalloc, at an address that
+ * is a multiple of alignment, a power of two. Alignments past 8 bytes
+ * take a region of their own, with the padding in front of it going back
+ * to the free lists, or kept in the block under the buddy engine. The
+ * storage is freed by myFree as usual; myRealloc keeps the alignment
+ * only while it resizes in place.
+ * It returns a NULL pointer if the storage cannot be allocated, or the
+ * alignment is not a power of two.
+ */
+void *myMallocAligned(size_t size, size_t alignment){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    void *ptr = malloc_aligned_block(size, alignment);
+    if (traced){
+        if (ptr != NULL){
+            trace_call(TRACE_ALIGNED, getCurrentPID(), size, ptr, alignment);
+        }
+        unlock_trace();
+    }
+    return ptr;
+}
 
-    // iterator head
-    struct mem_region *head = pool;
-
-    // iterate through LL
-    int iterated = 0;
-    while (iterated < POOL_SIZE){
-        // find a block large enough, first fit algorithm
-        if (head->free && head->size >= rounded){
-            mem = head;
-            // split if the space larger than 64;
-            if ((head->size - rounded) > 64){
-                struct mem_region *next;
-                next = (struct mem_region *)&head->data[rounded];
-                next->free = 1;
-                next->size = head->size - rounded - mem_region_size;
+// myMallocBatch without tracing
+static size_t malloc_batch(size_t size, size_t count, void *out[]){
+    size_t done = 0;
+    if (size != 0 && size <= CHUNK_MAX){
+        // round up size to 8-byte
+        size_t rounded = ((size + 7) / 8) * 8;
+        struct thread_cache *cache = threaded ? my_thread_cache() : NULL;
+
+        // small objects come from slabs, without the lock if a thread cache owns them
+        if (rounded <= SLAB_MAX && cache != NULL){
+            int class = rounded / 8 - 1;
+            for (; done < count && (out[done] = cache_slab_alloc(cache, class)) != NULL; done++){
+                count_malloc(&cache->stats, size, rounded);
             }
-            break;
+        }
+        else if (rounded <= SLAB_MAX){
+            int class = rounded / 8 - 1;
+            lock_heap();
+            for (; done < count && (out[done] = slab_alloc(currentPCB->arena, class)) != NULL; done++){
+                count_malloc(&heap_stats, size, rounded);
+            }
+            unlock_heap();
         }
         else{
-            iterated = iterated + mem_region_size + head->size;
-            head = (struct mem_region *)&head->data[head->size];
+            if (rounded < MIN_REGION_SIZE){
+                rounded = MIN_REGION_SIZE;
+            }
+            lock_heap();
+            done = engine->alloc_batch(currentPCB->arena, rounded, count, out);
+            for (size_t i = 0; i < done; i++){
+                count_malloc(&heap_stats, size, region_size((struct mem_region *)out[i] - 1));
+            }
+            unlock_heap();
         }
     }
 
-    // cannot find the appropriate block
-    if (iterated == POOL_SIZE){
-        return NULL; 
+    if (done < count){
+        struct mem_stats *stats = lock_stats();
+        add_count(&stats->failed_mallocs, count - done);
+        unlock_stats(stats);
+        for (size_t i = done; i < count; i++){
+            out[i] = NULL;
+        }
     }
-    
-    mem->free = 0;
-    mem->size = rounded;
-    mem->pid = getCurrentPID();
-    return mem->data;
+    return done;
+}
+
+/*
+ * myMallocBatch allocates count blocks of size bytes like myMalloc, and
+ * stores their pointers in out. It takes the lock once for all of them,
+ * and carves regions out of a single free region as long as one holds
+ * them all. It returns how many blocks it allocated; out has NULL for
+ * the rest.
+ */
+size_t myMallocBatch(size_t size, size_t count, void *out[]){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    size_t done = malloc_batch(size, count, out);
+    if (traced){
+        for (size_t i = 0; i < done; i++){
+            trace_call(TRACE_MALLOC, getCurrentPID(), size, out[i], 0);
+        }
+        unlock_trace();
+    }
+    return done;
+}
+
+// check that ptr could be a block address: 8-byte aligned and inside the pool
+static int in_pool(void *ptr){
+    return ptr != NULL && (uintptr_t)ptr % 8 == 0 && (uint8_t *)ptr > (uint8_t *)pool
+            && (uint8_t *)ptr < (uint8_t *)pool + pool_size;
+}
+
+/*
+ * Check that the region at block address ptr, which is in the pool and
+ * not a slab object, is allocated to the current process. Return 1 if it
+ * is, otherwise the error code myFreeErrorCode gives for it.
+ * Caller holds the lock.
+ */
+static int check_region(void *ptr){
+    // the side table knows every block address
+    struct mem_region *head = (struct mem_region *)ptr - 1;
+    if (!is_region_start(head)){
+        return 2;
+    }
+
+    // attempt to free storage that is not currently allocated
+    if (head->free){
+        return 3;
+    }
+
+    // attempt to free storage owned by a different PID
+    if (head->pid != getCurrentPID()){
+        return 4;
+    }
+    return 1;
+}
+
+/*
+ * Check that ptr is the block address of storage currently allocated to
+ * the current process. Return 1 if it is, otherwise the error code
+ * myFreeErrorCode gives for it.
+ */
+static int check_block(void *ptr){
+    // attempt to free storage at an invalid block address
+    if (!in_pool(ptr)){
+        return 2;
+    }
+
+    // slab objects have no bookkeeping section, the slab keeps their state
+    if (is_slab_object(ptr)){
+        struct slab *slab = slab_of(ptr);
+        int index = slab_index(slab, ptr);
+        if (index < 0){
+            return 2;
+        }
+        if (slab_object_free(slab, index)){
+            return 3;
+        }
+        if (slab->arena->pid != getCurrentPID()){
+            return 4;
+        }
+        return 1;
+    }
+
+    // other threads change the side table and headers under the lock
+    lock_heap();
+    int code = check_region(ptr);
+    unlock_heap();
+    return code;
+}
+
+// myFreeErrorCode without tracing, also used by the calls built on it
+static int free_block(void *ptr){
+    int code;
+    if (in_pool(ptr) && !is_slab_object(ptr)){
+        // regions are checked and freed under one lock
+        lock_heap();
+        code = check_region(ptr);
+        if (code == 1){
+            struct mem_region *head = (struct mem_region *)ptr - 1;
+            count_free(&heap_stats, region_size(head));
+            engine->free(currentPCB->arena, head);
+        }
+        unlock_heap();
+    }
+    else{
+        code = check_block(ptr);
+        if (code == 1){
+            struct slab *slab = slab_of(ptr);
+            return free_slab_object(slab, slab_index(slab, ptr), ptr);
+        }
+    }
+
+    if (code != 1){
+        struct mem_stats *stats = lock_stats();
+        add_count(&stats->failed_frees, 1);
+        unlock_stats(stats);
+    }
+    return code;
 }
 
 /*
@@ -110,100 +2889,492 @@ void *myMalloc(size_t size){
  * 4 means attempt to free storage owned by a different PID.
  */
 int myFreeErrorCode(void *ptr){
-    // attempt to free storage at an invalid block address
-    if (ptr == NULL){
-        return 2;
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    int code = free_block(ptr);
+    if (traced){
+        if (code == 1){
+            trace_call(TRACE_FREE, getCurrentPID(), 0, ptr, 0);
+        }
+        unlock_trace();
     }
+    return code;
+}
 
-    // ptr is at the beginning of the pool
-    struct mem_region *head = pool;
-    struct mem_region *prev;
-    if (head->data == ptr){
-        if (head->pid != getCurrentPID()){
-            // attempt to free storage owned by a different PID
-            return 4;
+/*
+ * myFree takes a pointer to a region of memory previously
+ * allocated by the myMalloc function and deallocates that region.
+ * If the value of the parameter is invalid, the call has no effect.
+ */
+void myFree(void *ptr){
+    (void)myFreeErrorCode(ptr);
+}
+
+static int compare_pointers(const void *a, const void *b){
+    uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+// myFreeBatch without tracing
+static size_t free_batch(void *ptrs[], size_t count, int codes[]){
+    // blocks from myMallocBatch come in address order already
+    for (size_t i = 1; i < count; i++){
+        if ((uintptr_t)ptrs[i - 1] > (uintptr_t)ptrs[i]){
+            qsort(ptrs, count, sizeof(void *), compare_pointers);
+            break;
         }
-        // deallocate
-        head->free = 1;
-	// possibly merge with next block
-	if (mem_region_size + head->size < POOL_SIZE){
-            struct mem_region *next;
-            next = (struct mem_region *)&head->data[head->size];
-            if (next->free){
-	        head->size = head->size + mem_region_size + next->size;
-	    }
-	}
-        return 1;
     }
-    prev = head;
-    head = (struct mem_region *)&head->data[head->size];
 
-    // iterate through LL to find ptr
-    int iterated = mem_region_size + prev->size;
-    while (iterated < POOL_SIZE){
-        if (head->data == ptr){
-            if (head->pid != getCurrentPID()){
-                return 4;
+    size_t freed = 0;
+    int locked = 0;
+    // regions lying one after the other are freed together
+    struct mem_region *first = NULL;
+    struct mem_region *last = NULL;
+    for (size_t i = 0; i < count; i++){
+        void *ptr = ptrs[i];
+        struct mem_region *head = (struct mem_region *)ptr - 1;
+        int repeated = i > 0 && ptr == ptrs[i - 1];
+        int region = !repeated && in_pool(ptr) && !is_slab_object(ptr);
+        if (region && !locked){
+            lock_heap();
+            locked = 1;
+        }
+        if (region && check_region(ptr) == 1){
+            if (first != NULL && head != next_region(last)){
+                engine->free_run(currentPCB->arena, first, last);
+                first = NULL;
             }
-            // attempt to free storage that is not currently allocated;
-            if (head->free){
-                return 3;
+            if (first == NULL){
+                first = head;
             }
-            // deallocate
-            head->free = 1;
-	    // possibly merge with next block
-	    if (iterated + mem_region_size + head->size < POOL_SIZE){
-                struct mem_region *next;
-                next = (struct mem_region *)&head->data[head->size];
-		if (next->free){
-		    head->size = head->size + mem_region_size + next->size;
-		}
-	    }
-            // possibly merge with previous block
-            if (prev->free){
-                prev->size = prev->size + mem_region_size + head->size; 
+            last = head;
+            count_free(&heap_stats, region_size(head));
+            codes[i] = 1;
+            freed++;
+            continue;
+        }
+
+        // the rest go the way of myFreeErrorCode, which counts the errors
+        if (first != NULL){
+            engine->free_run(currentPCB->arena, first, last);
+            first = NULL;
+        }
+        if (locked){
+            unlock_heap();
+            locked = 0;
+        }
+        codes[i] = free_block(ptr);
+        freed += codes[i] == 1;
+    }
+
+    if (first != NULL){
+        engine->free_run(currentPCB->arena, first, last);
+    }
+    if (locked){
+        unlock_heap();
+    }
+    return freed;
+}
+
+/*
+ * myFreeBatch deallocates the count blocks in ptrs like myFreeErrorCode,
+ * in a single sweep: it sorts ptrs by address, in place, and frees blocks
+ * lying one after the other as a single region, under one lock.
+ * It stores the code of myFreeErrorCode for ptrs[i], after sorting, in
+ * codes[i], and returns how many blocks it freed.
+ */
+size_t myFreeBatch(void *ptrs[], size_t count, int codes[]){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    size_t freed = free_batch(ptrs, count, codes);
+    if (traced){
+        for (size_t i = 0; i < count; i++){
+            if (codes[i] == 1){
+                trace_call(TRACE_FREE, getCurrentPID(), 0, ptrs[i], 0);
             }
-            return 1;
         }
-        else{
-            iterated = iterated + mem_region_size + head->size;
-            prev = head;
-            head = (struct mem_region *)&head->data[head->size];
+        unlock_trace();
+    }
+    return freed;
+}
+
+/*
+ * myBlockSize returns the number of bytes usable at ptr, storage of the
+ * current process allocated by myMalloc, which is at least the size
+ * asked for. It returns 0 if ptr is not such storage.
+ */
+size_t myBlockSize(void *ptr){
+    if (check_block(ptr) != 1){
+        return 0;
+    }
+    if (is_slab_object(ptr)){
+        return slab_of(ptr)->object_size;
+    }
+    lock_heap();
+    size_t size = region_size((struct mem_region *)ptr - 1);
+    unlock_heap();
+    return size;
+}
+
+// myRealloc without tracing
+static void *realloc_block(void *ptr, size_t size){
+    if (ptr == NULL){
+        return malloc_block(size);
+    }
+    if (size == 0){
+        (void)free_block(ptr);
+        return NULL;
+    }
+    if (check_block(ptr) != 1 || size > CHUNK_MAX){
+        return NULL;
+    }
+
+    // round up size to 8-byte
+    size_t rounded = ((size + 7) / 8) * 8;
+    size_t old_size;
+    if (is_slab_object(ptr)){
+        // slab objects keep their size
+        old_size = slab_of(ptr)->object_size;
+        if (rounded <= old_size){
+            return ptr;
+        }
+    }
+    else{
+        struct mem_region *head = (struct mem_region *)ptr - 1;
+        if (rounded < MIN_REGION_SIZE){
+            rounded = MIN_REGION_SIZE;
+        }
+        lock_heap();
+        old_size = region_size(head);
+        int resized = engine->resize(currentPCB->arena, head, rounded) == 0;
+        heap_stats.bytes_in_use += region_size(head) - old_size;
+        update_peak();
+        unlock_heap();
+        if (resized){
+            return ptr;
         }
     }
 
-    // ptr not found; invalid block address
-    if (iterated == POOL_SIZE){
-        return 2; 
+    void *new_ptr = malloc_block(size);
+    if (new_ptr == NULL){
+        return NULL;
     }
-    return 1;
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    (void)free_block(ptr);
+    return new_ptr;
 }
 
 /*
- * myFree takes a pointer to a region of memory previously
- * allocated by the myMalloc function and deallocates that region.
- * If the value of the parameter is invalid, the call has no effect.
+ * myRealloc changes the size of the storage at ptr, allocated by myMalloc,
+ * to size bytes and returns a pointer to it. The storage is resized in
+ * place when the free space after it allows, otherwise it moves to a new
+ * region, with its contents copied up to the smaller of the two sizes.
+ * A NULL ptr makes it act as myMalloc, and a size of 0 as myFree.
+ * It returns a NULL pointer, leaving the storage alone, if ptr is not
+ * storage of the current process or no region of size bytes is left.
  */
-void myFree(void *ptr){
-    (void)myFreeErrorCode(ptr);
+void *myRealloc(void *ptr, size_t size){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    int valid = traced && ptr != NULL && check_block(ptr) == 1;
+    void *new_ptr = realloc_block(ptr, size);
+    if (traced){
+        // a NULL result is only a change if it freed ptr
+        if (new_ptr != NULL || (valid && size == 0)){
+            trace_call(TRACE_REALLOC, getCurrentPID(), size, new_ptr, trace_id(ptr));
+        }
+        unlock_trace();
+    }
+    return new_ptr;
+}
+
+// myCalloc without tracing
+static void *calloc_block(size_t count, size_t size){
+    if (count != 0 && size > CHUNK_MAX / count){
+        return refuse_malloc();
+    }
+    size_t total = count * size;
+
+    // small storage comes from slabs, and is cheap to clear
+    if (total <= SLAB_MAX){
+        void *ptr = malloc_block(total);
+        if (ptr != NULL){
+            memset(ptr, 0, total);
+        }
+        return ptr;
+    }
+
+    // round up size to 8-byte
+    size_t rounded = ((total + 7) / 8) * 8;
+    lock_heap();
+    struct mem_region *mem = engine->alloc(currentPCB->arena, rounded);
+    int zeroed = mem != NULL && zero_pages;
+    count_malloc(&heap_stats, total, mem == NULL ? 0 : region_size(mem));
+    unlock_heap();
+    if (mem == NULL){
+        return NULL;
+    }
+
+    if (!zeroed){
+        memset(mem->data, 0, total);
+        return mem->data;
+    }
+    // the page holding the links and the one holding the footer
+    // of the free region mem came from were not released
+    uint8_t *first = (uint8_t *)(((uintptr_t)mem->data + FREE_LINKS_SIZE
+            + page_size - 1) & ~(page_size - 1));
+    uint8_t *last = (uint8_t *)(((uintptr_t)mem->data + total - sizeof(size_t)) & ~(page_size - 1));
+    if (first < last){
+        memset(mem->data, 0, first - mem->data);
+        memset(last, 0, mem->data + total - last);
+    }
+    else{
+        memset(mem->data, 0, total);
+    }
+    return mem->data;
+}
+
+/*
+ * myCalloc allocates storage for count objects of size bytes each, like
+ * myMalloc, and sets it to zero. Pages of a large region the OS has not
+ * committed since it was last released read as zeros already, so only
+ * the rest is cleared. It returns a NULL pointer if the storage cannot be
+ * allocated, the total size overflows, or it is 0 bytes.
+ */
+void *myCalloc(size_t count, size_t size){
+    int traced = atomic_load_explicit(&tracing, memory_order_relaxed);
+    if (traced){
+        lock_trace();
+    }
+    void *ptr = calloc_block(count, size);
+    if (traced){
+        if (ptr != NULL){
+            trace_call(TRACE_CALLOC, getCurrentPID(), count * size, ptr, 0);
+        }
+        unlock_trace();
+    }
+    return ptr;
+}
+
+/*
+ * The memory map is put together in map_buffer and written out a buffer
+ * at a time, with its numbers formatted by hand: a pool can hold far too
+ * many regions for a stdio call per region. It is only used under the
+ * heap lock.
+ */
+#define MAP_BUFFER_SIZE (1 << 16)
+
+static char map_buffer[MAP_BUFFER_SIZE];
+static size_t map_length;
+static int map_fd;
+static int map_failed; // a write failed
+static const struct mem_map_config *map_config;
+
+// totals of the summary
+static uint64_t map_used, map_used_bytes, map_free, map_free_bytes, map_largest_free;
+
+// regions and bytes used per slot of the PCB table, for the summary
+struct map_usage {
+    uint64_t regions;
+    uint64_t bytes;
+};
+static struct map_usage *map_usage;
+
+static void map_flush(){
+    char *next = map_buffer;
+    while (map_length > 0 && !map_failed){
+        ssize_t written = write(map_fd, next, map_length);
+        if (written < 0 && errno != EINTR){
+            map_failed = 1;
+        }
+        if (written > 0){
+            next += written;
+            map_length -= written;
+        }
+    }
+    map_length = 0;
+}
+
+static void map_append(const void *data, size_t length){
+    if (map_length + length > MAP_BUFFER_SIZE){
+        map_flush();
+    }
+    memcpy(map_buffer + map_length, data, length);
+    map_length += length;
+}
+
+static void map_string(const char *string){
+    map_append(string, strlen(string));
+}
+
+// append value in decimal, right-aligned in width characters
+static void map_number(uint64_t value, int width){
+    char digits[24];
+    int length = 0;
+    do {
+        digits[sizeof(digits) - ++length] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (length < width){
+        digits[sizeof(digits) - ++length] = ' ';
+    }
+    map_append(digits + sizeof(digits) - length, length);
+}
+
+// append addr the way %p prints it
+static void map_address(void *addr){
+    char digits[2 + 16];
+    uintptr_t value = (uintptr_t)addr;
+    int length = 0;
+    do {
+        digits[sizeof(digits) - ++length] = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value != 0);
+    digits[sizeof(digits) - ++length] = 'x';
+    digits[sizeof(digits) - ++length] = '0';
+    map_append(digits + sizeof(digits) - length, length);
+}
+
+// add a region to the memory map in the mode asked for
+static void map_region(uint32_t pid, int free, size_t size, void *addr){
+    if ((uint8_t *)addr < (uint8_t *)map_config->begin
+            || (map_config->end != NULL && (uint8_t *)addr >= (uint8_t *)map_config->end)){
+        return;
+    }
+
+    switch (map_config->mode){
+        case MEM_MAP_REGIONS:
+            map_string(" ");
+            map_number(pid, 3);
+            map_string(free ? "   yes  " : "    no  ");
+            map_number(size, 9);
+            map_string("  ");
+            map_address(addr);
+            map_string("\r\n");
+            break;
+        case MEM_MAP_JSON:
+            map_string("{\"pid\":");
+            map_number(pid, 0);
+            map_string(free ? ",\"free\":true,\"size\":" : ",\"free\":false,\"size\":");
+            map_number(size, 0);
+            map_string(",\"addr\":\"");
+            map_address(addr);
+            map_string("\"}\n");
+            break;
+        case MEM_MAP_BINARY: {
+            struct mem_map_record record = {(uintptr_t)addr, size, pid, free};
+            map_append(&record, sizeof(record));
+            break;
+        }
+        case MEM_MAP_SUMMARY:
+            if (free){
+                map_free++;
+                map_free_bytes += size;
+                if (size > map_largest_free){
+                    map_largest_free = size;
+                }
+            }
+            else{
+                map_used++;
+                map_used_bytes += size;
+                size_t slot = find_pcb_slot(pid);
+                if (map_usage != NULL && slot < pcb_table_size){
+                    map_usage[slot].regions++;
+                    map_usage[slot].bytes += size;
+                }
+            }
+            break;
+    }
+}
+
+// append the totals and usage per PID gathered by map_region
+static void map_summary(){
+    map_string("used regions:  ");
+    map_number(map_used, 0);
+    map_string(", ");
+    map_number(map_used_bytes, 0);
+    map_string(" bytes\r\nfree regions:  ");
+    map_number(map_free, 0);
+    map_string(", ");
+    map_number(map_free_bytes, 0);
+    map_string(" bytes\r\nlargest free:  ");
+    map_number(map_largest_free, 0);
+    // share of the free bytes a single request cannot get
+    map_string(" bytes\r\nfragmentation: ");
+    uint64_t per_mille = map_free_bytes == 0 ? 0 : 1000 - map_largest_free * 1000 / map_free_bytes;
+    map_number(per_mille / 10, 0);
+    map_string(".");
+    map_number(per_mille % 10, 0);
+    map_string("%\r\n\r\n pid   regions         bytes\r\n");
+    map_string("------------------------------\r\n");
+    for (size_t slot = 0; map_usage != NULL && slot < pcb_table_size; slot++){
+        if (pcb_table[slot] != NULL){
+            map_string(" ");
+            map_number(pcb_table[slot]->pid, 3);
+            map_number(map_usage[slot].regions, 10);
+            map_number(map_usage[slot].bytes, 14);
+            map_string("\r\n");
+        }
+    }
 }
 
 /*
- * print out a map of all used and free regions in the 128M byte region
- * of memory.
+ * memoryMapConfig writes out the regions of the pool, or those starting
+ * in a range of addresses, in the mode config asks for. A NULL config
+ * prints a line per region like memoryMap. Regions sitting in a thread
+ * cache are shown as free. Spans are shown as the regions inside them,
+ * and slabs as their objects, with runs of free objects as one region.
+ * Return 0 if succeed, return 1 if writing failed.
  */
+int memoryMapConfig(const struct mem_map_config *config){
+    static const struct mem_map_config defaults = {MEM_MAP_REGIONS, NULL, NULL, 0};
+    if (config == NULL){
+        config = &defaults;
+    }
+    if (pool == NULL){
+        fprintf(stderr, "Error: Memory pool is not initialized.\n");
+        return 1;
+    }
+    fflush(stdout);
+
+    lock_heap();
+    map_config = config;
+    map_fd = config->fd == 0 ? STDOUT_FILENO : config->fd;
+    map_failed = 0;
+    map_length = 0;
+    if (config->mode == MEM_MAP_REGIONS){
+        map_string(" pid  free    size        addr\r\n");
+        map_string("-------------------------------------\r\n");
+    }
+    else if (config->mode == MEM_MAP_SUMMARY){
+        map_used = map_used_bytes = map_free = map_free_bytes = map_largest_free = 0;
+        map_usage = map_zeroed(pcb_table_size * sizeof(struct map_usage));
+    }
+
+    engine->walk(map_region);
+
+    if (config->mode == MEM_MAP_REGIONS){
+        map_string("\n");
+    }
+    else if (config->mode == MEM_MAP_SUMMARY){
+        map_summary();
+        map_string("\n");
+        unmap_zeroed(map_usage, pcb_table_size * sizeof(struct map_usage));
+        map_usage = NULL;
+    }
+    map_flush();
+    int failed = map_failed;
+    unlock_heap();
+    return failed;
+}
+
+// print out a map of all used and free regions of the pool
 void memoryMap(){
-    struct mem_region *head = pool;
-     
-    fputs(" pid  free    size        addr\r\n", stdout);
-    fputs("-------------------------------------\r\n", stdout);
-    // iterate through LL
-    int iterated = 0;
-    while (iterated < POOL_SIZE){
-        fprintf(stdout, " %3d   %3s  %9d  %p\r\n",\
-                head->pid, head->free ? "yes" : "no", head->size, head->data);
-        iterated = iterated + mem_region_size + head->size;
-        head = (struct mem_region *)&head->data[head->size];
-    }
-    fputs("\n", stdout);
+    memoryMapConfig(NULL);
 }
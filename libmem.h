@@ -4,34 +4,174 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
-#define POOL_SIZE 134217728
+#define POOL_SIZE 134217728 // default initial size of the pool
+#define POOL_MAX_SIZE ((size_t)16 << 30) // default size the pool may grow to
+#define MAX_PID 0xFFFFFF // PIDs are stored in 24 bits
+
+struct arena;
 
 // Process Control Block
 struct pcb {
     uint32_t pid;
+    struct arena *arena; // where the process allocates from
 };
 
 // Bookkeeping region
+// Its data size is kept in 8-byte units, so a region holds up to 8GB.
+// A free region also repeats its size in a footer at the end of its data,
+// so the region after it can find it through prev_free.
+// It is only read and changed under the heap lock (see myEnableMultithreading).
 struct mem_region {
     uint32_t free: 1;
-    uint32_t size: 31;
-    uint32_t pid;
+    uint32_t prev_free: 1;
+    uint32_t units: 30;
+    uint32_t : 0;
+    uint32_t pid: 24;
+    uint32_t : 0;
     uint8_t data[0];
 };
 
+// Allocator engines managing the pool
+enum mem_engine {
+    MEM_ENGINE_FREE_LIST, // segregated free lists, an arena per process
+    MEM_ENGINE_BUDDY // binary buddy system
+};
+
+// Where the free list engine places a region, see mySetPlacementPolicy
+enum mem_policy {
+    MEM_POLICY_GOOD_FIT, // head of the first free list whose regions all fit
+    MEM_POLICY_NEXT_FIT, // first fit in the list of the size, from where the last search stopped
+    MEM_POLICY_BEST_FIT, // smallest region that fits, searched in the free lists
+    MEM_POLICY_TREE_FIT // smallest region that fits, large ones kept in a tree by size
+};
+
+// Options for myInitializeMemoryConfig
+struct mem_config {
+    enum mem_engine engine;
+    size_t pool_size; // initial size, POOL_SIZE if 0; the pool grows by chunks of it
+    size_t max_pool_size; // size the pool may grow to, POOL_MAX_SIZE if 0
+    enum mem_policy policy; // the buddy engine refuses all but MEM_POLICY_GOOD_FIT
+};
+
+// Output of memoryMapConfig
+enum mem_map_mode {
+    MEM_MAP_REGIONS, // a line per region, as memoryMap prints
+    MEM_MAP_SUMMARY, // totals, largest free region, fragmentation, usage per PID
+    MEM_MAP_JSON, // a JSON object per line and region
+    MEM_MAP_BINARY // a mem_map_record per region
+};
+
+struct mem_map_config {
+    enum mem_map_mode mode;
+    void *begin; // only regions starting at or after begin
+    void *end; // and before end, no bound if NULL
+    int fd; // file written to, stdout if 0
+};
+
+struct mem_map_record {
+    uint64_t addr; // of the data
+    uint64_t size;
+    uint32_t pid;
+    uint32_t free;
+};
+
+#define MEM_STATS_SIZES 34 // size histogram buckets, one per power of two up to 8GB
+
+// Counters of the allocator, see myMemoryStats
+struct mem_stats {
+    uint64_t mallocs; // storage handed out, by any of the calls
+    uint64_t frees;
+    uint64_t failed_mallocs;
+    uint64_t failed_frees; // myFreeErrorCode calls returning an error
+    uint64_t bytes_in_use; // of live storage, rounded up as the allocator did
+    uint64_t peak_bytes_in_use;
+    uint64_t searches; // free list searches for a region
+    uint64_t scanned; // free regions looked at by them
+    uint64_t splits; // regions split in two
+    uint64_t coalesces; // free regions merged with a neighbour
+    uint64_t sizes[MEM_STATS_SIZES]; // storage of 2^i to 2^(i+1)-1 bytes asked for
+};
+
+/*
+ * Allocation trace, recorded by myStartTrace. The file is a trace_header
+ * followed by a trace_record for every call that changed the heap.
+ * Blocks are named by their offset in the pool in 8-byte units, which
+ * is unique among live blocks; 0 stands for a NULL pointer.
+ */
+#define TRACE_MAGIC 0x52544d4c // "LMTR"
+#define TRACE_VERSION 1
+
+enum trace_op {
+    TRACE_MALLOC,
+    TRACE_FREE,
+    TRACE_REALLOC,
+    TRACE_CALLOC,
+    TRACE_ALIGNED,
+    TRACE_FREE_ALL // myFreeAllForPID of the record's PID
+};
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct trace_record {
+    uint32_t op: 8;
+    uint32_t pid: 24; // process the call was made for
+    uint32_t delta; // nanoseconds since the previous record, saturating
+    uint64_t size; // bytes asked for, count times size for myCalloc
+    uint64_t id; // block returned, or freed by myFree
+    uint64_t arg; // block given to myRealloc, alignment of myMallocAligned
+};
+
 extern struct pcb *currentPCB;
 extern struct mem_region *pool;
+extern size_t pool_size;
 
 uint32_t getCurrentPID();
 
 int myInitializeMemory();
 
+int mySetPlacementPolicy(enum mem_policy policy);
+
+int myInitializeMemoryConfig(const struct mem_config *config);
+
+void myTeardownMemory();
+
+int myEnableMultithreading();
+
+struct pcb *myCreatePCB(uint32_t pid);
+
+int mySwitchPCB(uint32_t pid);
+
+int myFreeAllForPID(uint32_t pid);
+
 void *myMalloc(size_t size);
 
+void *myMallocAligned(size_t size, size_t alignment);
+
+size_t myMallocBatch(size_t size, size_t count, void *out[]);
+
 int myFreeErrorCode(void *ptr);
 
 void myFree(void *ptr);
 
+size_t myFreeBatch(void *ptrs[], size_t count, int codes[]);
+
+size_t myBlockSize(void *ptr);
+
+void *myRealloc(void *ptr, size_t size);
+
+void *myCalloc(size_t count, size_t size);
+
+int myMemoryStats(struct mem_stats *stats);
+
+int myStartTrace(const char *path);
+
+int myStopTrace();
+
 void memoryMap();
 
+int memoryMapConfig(const struct mem_map_config *config);
+
 #endif
@@ -32,6 +32,20 @@ int main(){
     memoryMap();
 
     // free PCB and memory pool
-    free(currentPCB);
-    free(pool);
+    myTeardownMemory();
+
+    // a pool grows up to its limit, even by less than a chunk
+    struct mem_config config = {MEM_ENGINE_FREE_LIST, 1 << 20, 4 << 20};
+    if (myInitializeMemoryConfig(&config)){
+        return 1;
+    }
+    void *p6 = myMalloc(3 << 20);
+    memoryMap();
+    myFree(p6);
+    myTeardownMemory();
+    if (p6 == NULL){
+        fprintf(stderr, "Error: The pool did not grow up to its limit.\n");
+        return 1;
+    }
+    return 0;
 }
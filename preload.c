@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "libmem.h"
+
+/*
+ * preload puts the malloc family on top of libmem, for libmem.so to
+ * stand in for the system malloc under unmodified programs:
+ *   LD_PRELOAD=./libmem.so program
+ * The first call sets up the pool with the free list engine, in
+ * multithreaded mode, once even if several threads make it at the same
+ * time. libmem maps its own bookkeeping from the OS, so setting it up
+ * does not call back in here. All storage belongs to
+ * PID 0. Pointers that did not come from the pool are never freed.
+ */
+
+static pthread_once_t setup = PTHREAD_ONCE_INIT;
+static int setup_failed = 0;
+
+static void set_up(){
+    setup_failed = myInitializeMemory() || myEnableMultithreading();
+}
+
+// set up the pool if it is not yet, return 0 if it is ready
+static int ready(){
+    pthread_once(&setup, set_up);
+    return setup_failed;
+}
+
+// the system malloc hands out storage for 0 bytes too
+static size_t at_least_one(size_t size){
+    return size == 0 ? 1 : size;
+}
+
+static void *out_of_memory(void *ptr){
+    if (ptr == NULL){
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void *malloc(size_t size){
+    if (ready()){
+        return out_of_memory(NULL);
+    }
+    return out_of_memory(myMalloc(at_least_one(size)));
+}
+
+void free(void *ptr){
+    if (ptr != NULL){
+        myFree(ptr);
+    }
+}
+
+void *calloc(size_t count, size_t size){
+    if (ready()){
+        return out_of_memory(NULL);
+    }
+    if (count == 0 || size == 0){
+        count = size = 1;
+    }
+    return out_of_memory(myCalloc(count, size));
+}
+
+void *realloc(void *ptr, size_t size){
+    if (ptr == NULL){
+        return malloc(size);
+    }
+    if (size == 0){
+        free(ptr);
+        return NULL;
+    }
+    return out_of_memory(myRealloc(ptr, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+    if (alignment == 0 || (alignment & (alignment - 1))){
+        errno = EINVAL;
+        return NULL;
+    }
+    if (ready()){
+        return out_of_memory(NULL);
+    }
+    return out_of_memory(myMallocAligned(at_least_one(size), alignment));
+}
+
+void *memalign(size_t alignment, size_t size){
+    return aligned_alloc(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size){
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1))){
+        return EINVAL;
+    }
+    void *ptr = ready() ? NULL : myMallocAligned(at_least_one(size), alignment);
+    if (ptr == NULL){
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *valloc(size_t size){
+    return aligned_alloc(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size){
+    size_t page = sysconf(_SC_PAGESIZE);
+    return aligned_alloc(page, (at_least_one(size) + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr){
+    return ptr == NULL ? 0 : myBlockSize(ptr);
+}
@@ -0,0 +1,513 @@
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "libmem.h"
+
+#define RSS_EVERY 4096 // calls between resident size samples
+#define BUCKETS 512 // latency histogram, see bucket_of
+
+/*
+ * replay runs an allocation trace recorded by myStartTrace against the
+ * allocators named on the command line, or all of them:
+ *   libmem   the free list engine
+ *   buddy    the buddy engine
+ *   malloc   the system malloc
+ * The calls are made on one thread in the order of the trace, each one
+ * timed for the median and 99th percentile latency, less the cost of
+ * reading the clock. libmem switches to the PCB of the recorded PID
+ * first. Every allocator runs in a child process of its own, so it starts
+ * from a fresh heap. As in bench, every block is written to on each of
+ * its pages; peak is the most resident memory the replay added, and
+ * fragmentation the share of it not taken by live blocks at their
+ * requested sizes. Calls that fail in the replay are counted, and later
+ * calls on their blocks skipped.
+ *
+ * Usage: replay trace_file [libmem|buddy|malloc ...]
+ */
+
+struct allocator {
+    const char *name;
+    int (*init)(); // return 0 if succeed
+    void *(*malloc)(size_t size);
+    void *(*calloc)(size_t count, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*aligned)(size_t size, size_t alignment);
+    void (*free)(void *ptr);
+    int (*switch_pid)(uint32_t pid); // NULL if the allocator has no processes
+    int (*free_all)(uint32_t pid); // NULL to free the blocks of pid one by one
+};
+
+// a live block of the trace
+struct block {
+    uint64_t id; // 0 if the slot is empty
+    uint8_t *ptr;
+    size_t size;
+    uint32_t pid;
+};
+
+struct result {
+    long calls;
+    long failed;
+    double seconds; // spent in the allocator
+    size_t live; // requested bytes of live blocks
+    size_t peak_live;
+    long rss; // resident pages when the replay started
+    long peak_rss;
+    uint64_t latency[BUCKETS];
+};
+
+struct trace_record *records;
+long record_num;
+long page_size;
+long clock_overhead; // ns spent reading the clock twice
+
+// open addressing table of the live blocks, sized before the replay
+struct block *table;
+size_t table_size; // a power of two
+
+static int init_libmem(){
+    return myInitializeMemory();
+}
+
+static int init_buddy(){
+    struct mem_config config = {MEM_ENGINE_BUDDY, 0, 0};
+    return myInitializeMemoryConfig(&config);
+}
+
+static int switch_libmem(uint32_t pid){
+    if (getCurrentPID() == pid || mySwitchPCB(pid) == 0){
+        return 0;
+    }
+    return myCreatePCB(pid) == NULL || mySwitchPCB(pid);
+}
+
+static int init_system(){
+    return 0;
+}
+
+static void *aligned_system(size_t size, size_t alignment){
+    void *ptr;
+    if (alignment < sizeof(void *)){
+        alignment = sizeof(void *);
+    }
+    return posix_memalign(&ptr, alignment, size) ? NULL : ptr;
+}
+
+const struct allocator allocators[] = {
+    {"libmem", init_libmem, myMalloc, myCalloc, myRealloc, myMallocAligned, myFree,
+            switch_libmem, myFreeAllForPID},
+    {"buddy", init_buddy, myMalloc, myCalloc, myRealloc, myMallocAligned, myFree,
+            switch_libmem, myFreeAllForPID},
+    {"malloc", init_system, malloc, calloc, realloc, aligned_system, free, NULL, NULL}
+};
+
+static long now_ns(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000L + time.tv_nsec;
+}
+
+// resident pages of the process
+static long resident_pages(){
+    long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL){
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2){
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident;
+}
+
+// histogram bucket of a latency: exact up to 64ns, then 16 per doubling
+static int bucket_of(long ns){
+    if (ns < 64){
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int log = 63 - __builtin_clzl(ns);
+    int bucket = 64 + (log - 6) * 16 + (int)((ns >> (log - 4)) & 15);
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+// lowest latency falling into bucket
+static long bucket_ns(int bucket){
+    if (bucket < 64){
+        return bucket;
+    }
+    int log = (bucket - 64) / 16 + 6;
+    return (1L << log) + ((long)((bucket - 64) % 16) << (log - 4));
+}
+
+static long percentile(struct result *result, double fraction){
+    long total = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++){
+        total += result->latency[bucket];
+    }
+    long seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++){
+        seen += result->latency[bucket];
+        if (seen > total * fraction){
+            return bucket_ns(bucket);
+        }
+    }
+    return bucket_ns(BUCKETS - 1);
+}
+
+// the clock is read twice around every call
+static void calibrate_clock(){
+    clock_overhead = 1000000;
+    for (int i = 0; i < 1000; i++){
+        long begin = now_ns();
+        long elapsed = now_ns() - begin;
+        if (elapsed < clock_overhead){
+            clock_overhead = elapsed;
+        }
+    }
+}
+
+static size_t slot_of(uint64_t id){
+    return (id * 0x9E3779B97F4A7C15ULL) >> 20 & (table_size - 1);
+}
+
+// the block with the given id, NULL if it is not live
+static struct block *find_block(uint64_t id){
+    for (size_t slot = slot_of(id); table[slot].id != 0; slot = (slot + 1) & (table_size - 1)){
+        if (table[slot].id == id){
+            return &table[slot];
+        }
+    }
+    return NULL;
+}
+
+static void insert_block(uint64_t id, uint8_t *ptr, size_t size, uint32_t pid){
+    size_t slot = slot_of(id);
+    while (table[slot].id != 0 && table[slot].id != id){
+        slot = (slot + 1) & (table_size - 1);
+    }
+    table[slot] = (struct block){id, ptr, size, pid};
+}
+
+// empty the slot of block, moving up the blocks probing past it
+static void remove_block(struct block *block){
+    size_t hole = block - table;
+    size_t slot = hole;
+    table[hole].id = 0;
+    for (;;){
+        slot = (slot + 1) & (table_size - 1);
+        if (table[slot].id == 0){
+            return;
+        }
+        size_t home = slot_of(table[slot].id);
+        // the block may move to the hole if its home is not between them
+        if ((slot > hole && (home <= hole || home > slot))
+                || (slot < hole && home <= hole && home > slot)){
+            table[hole] = table[slot];
+            table[slot].id = 0;
+            hole = slot;
+        }
+    }
+}
+
+// count a call, sampling the resident size now and then
+static void count_call(struct result *result, long begin){
+    long elapsed = now_ns() - begin;
+    result->latency[bucket_of(elapsed - clock_overhead)]++;
+    result->seconds += elapsed / 1e9;
+    result->calls++;
+    if (result->calls % RSS_EVERY == 0){
+        long rss = resident_pages();
+        if (rss > result->peak_rss){
+            result->peak_rss = rss;
+        }
+    }
+}
+
+// write to every page of a new block and keep it in the table
+static void add_block(struct result *result, struct trace_record *record, uint8_t *ptr){
+    for (size_t offset = 0; offset < record->size; offset += page_size){
+        ptr[offset] = 1;
+    }
+    ptr[record->size - 1] = 1;
+    insert_block(record->id, ptr, record->size, record->pid);
+    result->live += record->size;
+    if (result->live > result->peak_live){
+        result->peak_live = result->live;
+    }
+}
+
+static void drop_block(struct result *result, struct block *block){
+    result->live -= block->size;
+    remove_block(block);
+}
+
+// free every live block of pid, or just forget them if free_all did
+static void drop_process(const struct allocator *allocator, struct result *result, uint32_t pid){
+    for (size_t slot = 0; slot < table_size; slot++){
+        // removing a block can move another one into this slot
+        while (table[slot].id != 0 && table[slot].pid == pid){
+            if (allocator->free_all == NULL){
+                long begin = now_ns();
+                allocator->free(table[slot].ptr);
+                count_call(result, begin);
+            }
+            drop_block(result, &table[slot]);
+        }
+    }
+}
+
+static void replay_record(const struct allocator *allocator, struct result *result,
+        struct trace_record *record){
+    if (record->op == TRACE_FREE_ALL){
+        if (allocator->free_all != NULL){
+            long begin = now_ns();
+            allocator->free_all(record->pid);
+            count_call(result, begin);
+        }
+        drop_process(allocator, result, record->pid);
+        return;
+    }
+
+    if (allocator->switch_pid != NULL && allocator->switch_pid(record->pid)){
+        result->failed++;
+        return;
+    }
+
+    struct block *block = NULL;
+    if (record->op == TRACE_FREE || (record->op == TRACE_REALLOC && record->arg != 0)){
+        // the block was never allocated if its call failed
+        block = find_block(record->op == TRACE_FREE ? record->id : record->arg);
+        if (block == NULL){
+            return;
+        }
+    }
+
+    uint8_t *ptr = NULL;
+    long begin = now_ns();
+    switch (record->op){
+        case TRACE_MALLOC:
+            ptr = allocator->malloc(record->size);
+            break;
+        case TRACE_CALLOC:
+            ptr = allocator->calloc(1, record->size);
+            break;
+        case TRACE_ALIGNED:
+            ptr = allocator->aligned(record->size, record->arg);
+            break;
+        case TRACE_REALLOC:
+            ptr = allocator->realloc(block == NULL ? NULL : block->ptr, record->size);
+            break;
+        case TRACE_FREE:
+            allocator->free(block->ptr);
+            break;
+    }
+    count_call(result, begin);
+
+    if (record->op == TRACE_FREE || (record->op == TRACE_REALLOC && record->size == 0)){
+        drop_block(result, block);
+        return;
+    }
+    if (ptr == NULL){
+        result->failed++;
+        return;
+    }
+    if (block != NULL){
+        drop_block(result, block);
+    }
+    add_block(result, record, ptr);
+}
+
+/*
+ * Replay the trace on allocator in a child process, and fill in result.
+ * Return 0 if succeed, return 1 if the child failed.
+ */
+static int run_child(const struct allocator *allocator, struct result *result){
+    int pipe_fds[2];
+    if (pipe(pipe_fds)){
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0){
+        return 1;
+    }
+
+    if (pid == 0){
+        close(pipe_fds[0]);
+        if (allocator->init()){
+            _exit(1);
+        }
+        memset(result, 0, sizeof(*result));
+        result->rss = resident_pages();
+        result->peak_rss = result->rss;
+        for (long i = 0; i < record_num; i++){
+            replay_record(allocator, result, &records[i]);
+        }
+        long rss = resident_pages();
+        if (rss > result->peak_rss){
+            result->peak_rss = rss;
+        }
+        if (write(pipe_fds[1], result, sizeof(*result)) != sizeof(*result)){
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(pipe_fds[1]);
+    int failed = read(pipe_fds[0], result, sizeof(*result)) != sizeof(*result);
+    close(pipe_fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return failed || !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+// read the trace at path into records, return 0 if succeed
+static int read_trace(const char *path){
+    FILE *file = fopen(path, "rb");
+    struct stat info;
+    struct trace_header header;
+    if (file == NULL || fstat(fileno(file), &info)
+            || fread(&header, sizeof(header), 1, file) != 1){
+        fprintf(stderr, "Error: Reading trace file %s failed.\n", path);
+        if (file != NULL){
+            fclose(file);
+        }
+        return 1;
+    }
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION){
+        fprintf(stderr, "Error: %s is not a trace of this version.\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    record_num = (info.st_size - sizeof(header)) / sizeof(struct trace_record);
+    records = malloc(record_num * sizeof(struct trace_record) + 1);
+    int failed = records == NULL
+            || fread(records, sizeof(struct trace_record), record_num, file) != (size_t)record_num;
+    fclose(file);
+    if (failed){
+        fprintf(stderr, "Error: Reading trace file %s failed.\n", path);
+    }
+    return failed;
+}
+
+/*
+ * Size the block table for the most blocks the trace keeps live at once,
+ * by running it against the table alone, and print what the trace holds.
+ * The table is left empty and touched, so it does not count as memory of
+ * a replay. Return 0 if succeed, return 1 if out of memory.
+ */
+static int size_table(){
+    size_t live = 0, peak_live = 0, blocks = 0;
+    uint64_t nanoseconds = 0;
+    table_size = 1024;
+    table = calloc(table_size, sizeof(struct block));
+
+    for (long i = 0; i < record_num && table != NULL; i++){
+        struct trace_record *record = &records[i];
+        struct block *block;
+        nanoseconds += record->delta;
+        switch (record->op){
+            case TRACE_FREE_ALL:
+                for (size_t slot = 0; slot < table_size; slot++){
+                    while (table[slot].id != 0 && table[slot].pid == record->pid){
+                        live -= table[slot].size;
+                        blocks--;
+                        remove_block(&table[slot]);
+                    }
+                }
+                continue;
+            case TRACE_REALLOC:
+            case TRACE_FREE:
+                block = find_block(record->op == TRACE_FREE ? record->id : record->arg);
+                if (block != NULL){
+                    live -= block->size;
+                    blocks--;
+                    remove_block(block);
+                }
+                if (record->op == TRACE_FREE || record->id == 0){
+                    continue;
+                }
+        }
+        insert_block(record->id, NULL, record->size, record->pid);
+        live += record->size;
+        blocks++;
+        if (live > peak_live){
+            peak_live = live;
+        }
+
+        // keep the table at most half full
+        if (blocks * 2 > table_size){
+            struct block *old = table;
+            table_size *= 2;
+            table = calloc(table_size, sizeof(struct block));
+            for (size_t slot = 0; table != NULL && slot < table_size / 2; slot++){
+                if (old[slot].id != 0){
+                    insert_block(old[slot].id, NULL, old[slot].size, old[slot].pid);
+                }
+            }
+            free(old);
+        }
+    }
+    if (table == NULL){
+        fprintf(stderr, "Error: Memory allocation for block table failed.\n");
+        return 1;
+    }
+    memset(table, 0, table_size * sizeof(struct block));
+
+    fprintf(stdout, "%ld calls over %.3f s, %.1f MB live at most\n\n",
+            record_num, nanoseconds / 1e9, (double)peak_live / (1 << 20));
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 2){
+        fprintf(stderr, "Usage: %s trace_file [libmem|buddy|malloc ...]\n", argv[0]);
+        return 1;
+    }
+    int allocator_num = sizeof(allocators) / sizeof(allocators[0]);
+    for (int i = 2; i < argc; i++){
+        int a = 0;
+        while (a < allocator_num && strcmp(argv[i], allocators[a].name)){
+            a++;
+        }
+        if (a == allocator_num){
+            fprintf(stderr, "Error: Unknown allocator %s.\n", argv[i]);
+            return 1;
+        }
+    }
+    if (read_trace(argv[1]) || size_table()){
+        return 1;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+    calibrate_clock();
+
+    fputs(" allocator       calls   ns/call   p50 ns   p99 ns   peak MB    frag   failed\n", stdout);
+    fputs("------------------------------------------------------------------------------\n", stdout);
+    for (int a = 0; a < allocator_num; a++){
+        // run the allocators asked for, or all of them
+        int asked = argc == 2;
+        for (int i = 2; i < argc; i++){
+            asked |= strcmp(argv[i], allocators[a].name) == 0;
+        }
+        if (!asked){
+            continue;
+        }
+
+        struct result result;
+        if (run_child(&allocators[a], &result)){
+            fprintf(stderr, "Error: Replay failed on %s.\n", allocators[a].name);
+            return 1;
+        }
+        double peak = (double)(result.peak_rss - result.rss) * page_size;
+        double fragmentation = peak > 0 ? 1 - result.peak_live / peak : 0;
+        fprintf(stdout, " %-9s  %10ld   %7.0f   %6ld   %6ld   %7.1f   %4.0f%%   %6ld\n",
+                allocators[a].name, result.calls,
+                result.calls > 0 ? result.seconds * 1e9 / result.calls : 0,
+                percentile(&result, 0.5), percentile(&result, 0.99),
+                peak / (1 << 20), fragmentation * 100, result.failed);
+        fflush(stdout);
+    }
+    return 0;
+}
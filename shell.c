@@ -1,15 +1,29 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 #include "libmem.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-#define LINE_SIZE 256 // lines of up to 256 characters
-#define COMMAND_NUM 10 // number of commands
+#define READ_SIZE (1 << 16) // bytes read from the input at a time
+#define COMMAND_NUM 14 // number of commands
+#define COMMAND_SLOTS 32 // slots of the command table, a power of two
 #define BYTE_MAX 255 // max value of a byte
 
 int argc = 0;
 char **argv;
+// fields of the line being run, which point into the line
+char **fields;
+size_t field_slots;
 struct commandEntry {
     char *name;
     int (*functionp)(int argc, char *argv[]);
@@ -17,62 +31,112 @@ struct commandEntry {
 
 
 // Data for use in parse_time function
-const char months[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-const char leap_months[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-char* month_strs[] = {"January", "Feburary", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December"};
+char* month_strs[] = {"January", "February", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December"};
 
 /*
- * Input timestamp (seconds after unix Epoch), microsecond, and time string
- * The program will convert the timestamp into human-readable string and store in time
+ * Convert days after the Unix Epoch into a year, month (0 for January)
+ * and day of the month, in constant time. The days are counted in eras
+ * of 400 years, which all have the same number of days, from the March
+ * before the date, so February comes last.
  */
-void parse_time(long int timestamp, long int microsecond, char* time){
-    // Leap year flag
-    int isleap = 0;
+void civil_from_days(long days, long *year, int *month, int *day){
+    days += 719468; // from March 1, 0000
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long day_of_era = days - era * 146097;
+    long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524
+                        - day_of_era / 146096) / 365;
+    long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int march_month = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * march_month + 2) / 5 + 1;
+    *month = march_month < 10 ? march_month + 2 : march_month - 10;
+    *year = year_of_era + era * 400 + (*month < 2);
+}
 
-    int second = timestamp % 60;
-    timestamp /= 60;
+// Write value in decimal, zero-padded to width digits, return the end
+char *put_digits(char *out, unsigned long value, int width){
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0 || length < width);
+    while (length > 0)
+        *out++ = digits[--length];
+    return out;
+}
 
-    int minute = timestamp % 60;
-    timestamp /= 60;
+// Write value, below 100, as two digits, return the end
+char *put_two_digits(char *out, unsigned value){
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    memcpy(out, pairs + 2 * value, 2);
+    return out + 2;
+}
 
-    int hour = timestamp % 24;
-    timestamp /= 24;
+// The date of the last timestamp format_time converted, e.g. "May 04, 2021 "
+struct date_cache {
+    long days;
+    size_t length;
+    char prefix[32];
+};
 
-    int year;
-    int four_years = timestamp / 1461; // Every four years has 1461 days
-    timestamp %= 1461;
-    if (timestamp < 730){
-        year = 1970 + 4 * four_years + timestamp / 365;
-        timestamp %= 365;
-    }
-    else if (730 <= timestamp && timestamp < 1096){
-        isleap = 1;
-        year = 1970 + 4 * four_years + 2;
-        timestamp -= 730;
-    }
-    else{
-        year = 1970 + 4 * four_years + 3;
-        timestamp -= 1096;
+/*
+ * Write a timestamp (seconds after the Unix Epoch) and microsecond as a
+ * human-readable string into time, without a NUL, and return its length.
+ * Timestamps on the day in cache reuse its date; others replace it.
+ */
+size_t format_time(long timestamp, long microsecond, char *time, struct date_cache *cache){
+    long days = timestamp / 86400;
+    long seconds = timestamp % 86400;
+    if (seconds < 0){
+        days--;
+        seconds += 86400;
     }
 
-    int month;
-    if (isleap){
-        for (month = 0; leap_months[month] < timestamp; month++){
-            timestamp -= leap_months[month];
-        }
+    if (cache->length == 0 || cache->days != days){
+        long year;
+        int month, day;
+        civil_from_days(days, &year, &month, &day);
+        char *out = cache->prefix;
+        size_t name_length = strlen(month_strs[month]);
+        memcpy(out, month_strs[month], name_length);
+        out += name_length;
+        *out++ = ' ';
+        out = put_two_digits(out, day);
+        *out++ = ',';
+        *out++ = ' ';
+        if (year < 0)
+            *out++ = '-';
+        out = put_digits(out, year < 0 ? -year : year, 1);
+        *out++ = ' ';
+        cache->days = days;
+        cache->length = out - cache->prefix;
     }
-    else{
-        for (month = 0; months[month] < timestamp; month++){
-            timestamp -= months[month];
-        }
-    }
-    // Convert month number to string
-    char* month_str = month_strs[month];
 
-    int day = timestamp + 1;
+    char *out = time;
+    memcpy(out, cache->prefix, cache->length);
+    out += cache->length;
+    out = put_two_digits(out, seconds / 3600);
+    *out++ = ':';
+    out = put_two_digits(out, seconds / 60 % 60);
+    *out++ = ':';
+    out = put_two_digits(out, seconds % 60);
+    *out++ = '.';
+    out = put_two_digits(out, microsecond / 10000);
+    out = put_two_digits(out, microsecond / 100 % 100);
+    out = put_two_digits(out, microsecond % 100);
+    return out - time;
+}
 
-    sprintf(time, "%s %02d, %d %02d:%02d:%02d.%06ld",
-            month_str, day, year, hour, minute, second, microsecond);
+/*
+ * Input timestamp (seconds after unix Epoch), microsecond, and time string
+ * The program will convert the timestamp into human-readable string and store in time
+ */
+void parse_time(long int timestamp, long int microsecond, char* time){
+    struct date_cache cache = {0, 0, ""};
+    time[format_time(timestamp, microsecond, time, &cache)] = '\0';
 }
 
 // Print out (human-readable) current time
@@ -100,8 +164,7 @@ int cmd_echo(int argc, char *argv[]) {
 
 // Exit the shell program
 int cmd_exit(int argc, char *argv[]){
-    free(currentPCB);
-    free(pool);
+    myTeardownMemory();
     exit(0);
     return 0; 
 }
@@ -112,17 +175,111 @@ int cmd_help(int argc, char *argv[]){
 Use \"echo\" to echo the words.\n\
 Type \"exit\" to exit the shell.\n\
 Type \"help\" to print out this help.\n\
-Use \"clockdate\" to convert timestamp to time string.\n\
+Use \"clockdate\" to convert timestamp to time string, or -f file for a timestamp per line.\n\
 Use \"malloc\" to allocate memory block.\n\
 Use \"free\" to free memory.\n\
-Type \"memorymap\" to print out current memory map.\n\
+Use \"memorymap\" to print out current memory map, -s for a summary, -j for JSON lines,\n\
+    -b for binary records, -r begin end for a range of addresses, -o file to write to a file.\n\
 Ues \"memset\" to set memory block to specified value.\n\
-Use \"memchk\" to validate if memory block is specified value.\n");
+Use \"memchk\" to validate if memory block is specified value.\n\
+Use \"pool\" to print out or set the size of the memory pool.\n\
+Type \"memstats\" to print out the allocator statistics.\n\
+Use \"time\" to run a command and print out the time, page faults and cycles it took.\n\
+Use \"repeat\" to run a command a number of times and print out its latencies.\n");
     return 0; 
 }
 
-// Convert UNIX timestamp to human-readable time string
+/*
+ * Convert the timestamps in fd, one per line, to time strings written to
+ * stdout. The input is parsed as it streams by, a block at a time, and the
+ * output is written a buffer at a time. Invalid lines are reported and
+ * skipped. Return 0 if every line converted, return 1 otherwise.
+ */
+int convert_stream(char *name, int fd){
+    static char input[READ_SIZE];
+    static char output[READ_SIZE];
+    size_t used = 0;
+    struct date_cache cache = {0, 0, ""};
+    long line = 1;
+    long seconds = 0;
+    int digits = 0;
+    int spaced = 0; // spaces came after the digits
+    int bad = 0; // the line so far is not a timestamp
+    int failed = 0;
+
+    fflush(stdout);
+    while (1){
+        ssize_t got = read(fd, input, READ_SIZE);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0){
+            fprintf(stderr, "%s: read failed\n", name);
+            failed = 1;
+            break;
+        }
+
+        // a last line without a newline ends at the end of input
+        int end = got == 0;
+        if (end && (digits || bad))
+            input[got++] = '\n';
+        for (char *next = input; next < input + got; next++){
+            char c = *next;
+            if (c >= '0' && c <= '9'){
+                if (spaced || seconds > (LONG_MAX - (c - '0')) / 10)
+                    bad = 1;
+                else
+                    seconds = seconds * 10 + (c - '0');
+                digits++;
+            }
+            else if (c == '\n'){
+                if (digits && !bad){
+                    used += format_time(seconds, 0, output + used, &cache);
+                    output[used++] = '\n';
+                    if (used > READ_SIZE - 64){
+                        if (write(STDOUT_FILENO, output, used) != (ssize_t)used)
+                            failed = 1;
+                        used = 0;
+                    }
+                }
+                else if (digits || bad){
+                    fprintf(stderr, "%s: line %ld is not a valid timestamp\n", name, line);
+                    failed = 1;
+                }
+                line++;
+                seconds = 0;
+                digits = spaced = bad = 0;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r')
+                bad = 1;
+            else if (digits)
+                spaced = 1;
+        }
+        if (end)
+            break;
+    }
+    if (used > 0 && write(STDOUT_FILENO, output, used) != (ssize_t)used)
+        failed = 1;
+    return failed;
+}
+
+/*
+ * clockdate converts a UNIX timestamp to a human-readable time string.
+ * With -f it converts every timestamp in a file, one per line, or in
+ * stdin if the file is "-".
+ */
 int cmd_clockdate(int argc, char *argv[]){
+    if (argc == 3 && !strcmp(argv[1], "-f")){
+        if (!strcmp(argv[2], "-"))
+            return convert_stream(argv[0], STDIN_FILENO);
+        int fd = open(argv[2], O_RDONLY);
+        if (fd < 0){
+            fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[2]);
+            return 1;
+        }
+        int failed = convert_stream(argv[0], fd);
+        close(fd);
+        return failed;
+    }
     if (argc != 2){
         fprintf(stderr, "%s: must accept one argument\n", argv[0]);
         return 1;
@@ -233,19 +390,219 @@ int cmd_free(int argc, char *argv[]){
 }
 
 /*
- * memorymap prints out the current memory map
- * by calling memoryMap(). It accepts no argument.
+ * memorymap prints out the current memory map by calling memoryMapConfig().
+ * Without options it prints a line per region. -s prints a summary
+ * instead, -j a JSON object per line and region, and -b binary records.
+ * -r begin end leaves out the regions starting outside [begin, end), and
+ * -o file writes to file instead of stdout. Addresses can be specified in
+ * decimal, octal, or hexadecimal format.
  */
 int cmd_memorymap(int argc, char *argv[]){
-    if (argc != 1){
-        fprintf(stderr, "%s: accept no argument\n", argv[0]);
-        return 1;
+    struct mem_map_config config = {MEM_MAP_REGIONS, NULL, NULL, 0};
+    char *path = NULL;
+
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-s") == 0)
+            config.mode = MEM_MAP_SUMMARY;
+        else if (strcmp(argv[i], "-j") == 0)
+            config.mode = MEM_MAP_JSON;
+        else if (strcmp(argv[i], "-b") == 0)
+            config.mode = MEM_MAP_BINARY;
+        else if (strcmp(argv[i], "-r") == 0 && i + 2 < argc){
+            long begin, end;
+            if (multi_strtol(argv[i + 1], &begin) || multi_strtol(argv[i + 2], &end))
+                return 1;
+            config.begin = (void *)begin;
+            config.end = (void *)end;
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            path = argv[++i];
+        else{
+            fprintf(stderr, "%s: usage: %s [-s | -j | -b] [-r begin end] [-o file]\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
     }
 
-    memoryMap();
+    if (path != NULL){
+        config.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (config.fd < 0){
+            fprintf(stderr, "%s: cannot open %s\n", argv[0], path);
+            return 1;
+        }
+    }
+    int failed = memoryMapConfig(&config);
+    if (path != NULL)
+        close(config.fd);
+    if (failed){
+        fprintf(stderr, "%s: writing the memory map failed\n", argv[0]);
+        return 1;
+    }
     return 0;
 }
 
+/*
+ * Kernels of memset and memchk. Ranges of many megabytes are split across
+ * threads. Filling is left to the C library's memset, which picks the
+ * widest stores the CPU has at run time; checking picks between AVX2,
+ * SSE2 and a word at a time the first time it runs.
+ */
+#define SPLIT_SIZE (16 << 20) // bytes for each thread at least
+#define MAX_THREADS 8
+
+// what checking a range found
+struct check_result {
+    size_t first; // offset of the first mismatching byte, SIZE_MAX if none
+    size_t mismatches;
+};
+
+// fold what checking the part at offset found into result
+static void add_check(struct check_result *result, size_t offset, struct check_result part){
+    if (result->first == SIZE_MAX && part.first != SIZE_MAX)
+        result->first = offset + part.first;
+    result->mismatches += part.mismatches;
+}
+
+static struct check_result check_bytes(const uint8_t *beg, size_t len, uint8_t val){
+    struct check_result result = {SIZE_MAX, 0};
+    for (size_t i = 0; i < len; i++){
+        if (beg[i] != val){
+            if (result.first == SIZE_MAX)
+                result.first = i;
+            result.mismatches++;
+        }
+    }
+    return result;
+}
+
+static struct check_result check_words(const uint8_t *beg, size_t len, uint8_t val){
+    const uint64_t low = 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t pattern = val * 0x0101010101010101ULL;
+    struct check_result result = {SIZE_MAX, 0};
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)){
+        uint64_t diff;
+        memcpy(&diff, beg + i, sizeof(diff));
+        diff ^= pattern;
+        if (diff != 0){
+            // top bit of every byte that differs
+            add_check(&result, i, (struct check_result){
+                result.first == SIZE_MAX ? check_bytes(beg + i, 8, val).first : 0,
+                __builtin_popcountll((((diff & low) + low) | diff) & ~low)});
+        }
+    }
+    add_check(&result, i, check_bytes(beg + i, len - i, val));
+    return result;
+}
+
+#if defined(__x86_64__)
+static struct check_result check_sse2(const uint8_t *beg, size_t len, uint8_t val){
+    __m128i pattern = _mm_set1_epi8(val);
+    struct check_result result = {SIZE_MAX, 0};
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16){
+        __m128i data = _mm_loadu_si128((const __m128i *)(beg + i));
+        unsigned differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(data, pattern)) & 0xffff;
+        if (differ != 0)
+            add_check(&result, i, (struct check_result){__builtin_ctz(differ),
+                                                        __builtin_popcount(differ)});
+    }
+    add_check(&result, i, check_words(beg + i, len - i, val));
+    return result;
+}
+
+__attribute__((target("avx2")))
+static struct check_result check_avx2(const uint8_t *beg, size_t len, uint8_t val){
+    __m256i pattern = _mm256_set1_epi8(val);
+    struct check_result result = {SIZE_MAX, 0};
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64){
+        __m256i low = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(beg + i)), pattern);
+        __m256i high = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(beg + i + 32)), pattern);
+        // the common case, 64 bytes that all match
+        if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(low, high)) == 0xffffffff)
+            continue;
+        uint64_t differ = ~((uint64_t)(unsigned)_mm256_movemask_epi8(high) << 32
+                            | (unsigned)_mm256_movemask_epi8(low));
+        add_check(&result, i, (struct check_result){__builtin_ctzll(differ),
+                                                    __builtin_popcountll(differ)});
+    }
+    add_check(&result, i, check_sse2(beg + i, len - i, val));
+    return result;
+}
+#endif
+
+typedef struct check_result (*check_kernel)(const uint8_t *beg, size_t len, uint8_t val);
+
+static check_kernel pick_check(){
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return check_avx2;
+    return check_sse2;
+#else
+    return check_words;
+#endif
+}
+
+// part of a range for a thread to fill or check
+struct range_job {
+    uint8_t *beg;
+    size_t len;
+    uint8_t val;
+    check_kernel check; // NULL to fill
+    struct check_result result;
+};
+
+static void *run_job(void *arg){
+    struct range_job *job = arg;
+    if (job->check == NULL)
+        memset(job->beg, job->val, job->len);
+    else
+        job->result = job->check(job->beg, job->len, job->val);
+    return NULL;
+}
+
+/*
+ * Fill len bytes from beg with val, or check them against val if check
+ * is not NULL, split across up to a thread per CPU for long ranges.
+ * Return what checking found.
+ */
+static struct check_result run_range(uint8_t *beg, size_t len, uint8_t val, check_kernel check){
+    size_t threads = len / SPLIT_SIZE;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > (size_t)cpus)
+        threads = cpus;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    if (threads == 0)
+        threads = 1;
+
+    struct range_job jobs[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+    // parts start on cache lines
+    size_t part = (len / threads + 63) & ~(size_t)63;
+    for (size_t t = 0; t < threads; t++){
+        size_t offset = t * part < len ? t * part : len;
+        size_t part_len = len - offset < part ? len - offset : part;
+        jobs[t] = (struct range_job){beg + offset, part_len, val, check, {SIZE_MAX, 0}};
+        if (t > 0)
+            started[t] = pthread_create(&ids[t], NULL, run_job, &jobs[t]) == 0;
+    }
+    run_job(&jobs[0]);
+
+    struct check_result result = {SIZE_MAX, 0};
+    for (size_t t = 0; t < threads; t++){
+        if (started[t])
+            pthread_join(ids[t], NULL);
+        else if (t > 0)
+            run_job(&jobs[t]);
+        add_check(&result, jobs[t].beg - beg, jobs[t].result);
+    }
+    return result;
+}
+
 /*
  * memset initializes every byte in a range of memory addresses to a
  * specified value. The first argument is the beginning address of an
@@ -265,7 +622,7 @@ int cmd_memset(int argc, char *argv[]){
     if (multi_strtol(argv[1], &beg_l))
         return 1;
     uint8_t *beg = (uint8_t *)beg_l;
-    if (beg < (uint8_t *)pool || ((uint8_t*)pool + POOL_SIZE) <= beg){
+    if (beg < (uint8_t *)pool || ((uint8_t*)pool + pool_size) <= beg){
         fprintf(stderr, "%s: %s is not within memory scope\n", argv[0], argv[1]);
         return 1;
     }
@@ -284,16 +641,13 @@ int cmd_memset(int argc, char *argv[]){
     long len;
     if (multi_strtol(argv[3], &len))
         return 1;
-    if (((uint8_t*)pool + POOL_SIZE) <= beg + len){
+    if (len < 0 || ((uint8_t*)pool + pool_size) <= beg + len){
         fprintf(stderr, "%s: %s exceeds memory scope\n", argv[0], argv[3]);
         return 1;
     }
 
     // Set value
-    while (len > 0){
-        len--;
-        *(beg + len) = val;
-    }
+    run_range(beg, len, val, NULL);
     return 0;
 }
 
@@ -303,7 +657,8 @@ int cmd_memset(int argc, char *argv[]){
  * of an allocated area of memory, the second is the specified value, and
  * the third is the length (in bytes) of the specified memory. All arguments
  * can be specified in decimal, octal, or hexadecimal format.
- * It outputs "memchk sucessful" or "memchk failed".
+ * It outputs "memchk successful", or "memchk failed" with the number of
+ * bytes that differ and the offset of the first one.
  */
 
 int cmd_memchk(int argc, char *argv[]){
@@ -317,7 +672,7 @@ int cmd_memchk(int argc, char *argv[]){
     if (multi_strtol(argv[1], &beg_l))
         return 1;
     uint8_t *beg = (uint8_t *)beg_l;
-    if (beg < (uint8_t *)pool || ((uint8_t*)pool + POOL_SIZE) <= beg){
+    if (beg < (uint8_t *)pool || ((uint8_t*)pool + pool_size) <= beg){
         fprintf(stderr, "%s: %s is not within memory scope\n", argv[0], argv[1]);
         return 1;
     }
@@ -336,23 +691,203 @@ int cmd_memchk(int argc, char *argv[]){
     long len;
     if (multi_strtol(argv[3], &len))
         return 1;
-    if (((uint8_t*)pool + POOL_SIZE) <= beg + len){
+    if (len < 0 || ((uint8_t*)pool + pool_size) <= beg + len){
         fprintf(stderr, "%s: %s exceeds memory scope\n", argv[0], argv[3]);
         return 1;
     }
 
     // Check value
-    while (len > 0){
-        len--;
-        if (*(beg + len) != val){
-            fprintf(stdout, "memchk failed\n"); 
-            break;
-        }
+    static check_kernel check;
+    if (check == NULL)
+        check = pick_check();
+    struct check_result result = run_range(beg, len, val, check);
+    if (result.mismatches != 0){
+        fprintf(stdout, "memchk failed: %zu bytes differ, the first at offset %zu\n",
+                result.mismatches, result.first);
+        return 1;
     }
     fprintf(stdout, "memchk successful\n"); 
     return 0;
 }
 
+/*
+ * pool prints out the size of the memory pool when given no argument.
+ * Otherwise it sets up a new pool, of the size in bytes given by the
+ * first argument and allowed to grow up to the optional second one.
+ * Every allocated block is freed. The arguments can be specified in
+ * decimal, hexadecimal, or octal format.
+ */
+int cmd_pool(int argc, char *argv[]){
+    if (argc > 3){
+        fprintf(stderr, "%s: accept at most two arguments\n", argv[0]);
+        return 1;
+    }
+    if (argc == 1){
+        fprintf(stdout, "%zu\n", pool_size);
+        return 0;
+    }
+
+    // Parse and check arguments
+    long sizes[2] = {0, 0};
+    for (int i = 1; i < argc; i++){
+        if (multi_strtol(argv[i], &sizes[i - 1]))
+            return 1;
+        if (sizes[i - 1] <= 0){
+            fprintf(stderr, "%s: size must be > 0\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Replace the pool
+    struct mem_config config = {MEM_ENGINE_FREE_LIST, sizes[0], sizes[1]};
+    myTeardownMemory();
+    if (myInitializeMemoryConfig(&config)){
+        fprintf(stderr, "%s: falling back to the default pool\n", argv[0]);
+        return myInitializeMemory();
+    }
+    return 0;
+}
+
+/*
+ * memstats prints out the counters of the allocator, from
+ * myMemoryStats(), and a histogram of the sizes asked for.
+ * It accepts no argument.
+ */
+int cmd_memstats(int argc, char *argv[]){
+    if (argc != 1){
+        fprintf(stderr, "%s: accept no argument\n", argv[0]);
+        return 1;
+    }
+
+    struct mem_stats stats;
+    if (myMemoryStats(&stats))
+        return 1;
+
+    fprintf(stdout, "calls:     %lu malloc, %lu free, %lu failed malloc, %lu failed free\n",
+            stats.mallocs, stats.frees, stats.failed_mallocs, stats.failed_frees);
+    fprintf(stdout, "in use:    %lu bytes, peak %lu bytes\n",
+            stats.bytes_in_use, stats.peak_bytes_in_use);
+    fprintf(stdout, "searches:  %lu, %.2f regions scanned per search\n", stats.searches,
+            stats.searches ? (double)stats.scanned / stats.searches : 0.0);
+    fprintf(stdout, "splits:    %lu, coalesces: %lu\n", stats.splits, stats.coalesces);
+    fprintf(stdout, "      size      calls\n");
+    for (int i = 0; i < MEM_STATS_SIZES; i++){
+        if (stats.sizes[i] != 0)
+            fprintf(stdout, " >= %6lu%c %10lu\n", (1UL << i) >> (i / 10 * 10),
+                    " KMG"[i / 10], stats.sizes[i]);
+    }
+    return 0;
+}
+
+struct commandEntry *find_command(const char *name);
+
+// Return the monotonic clock in nanoseconds
+static uint64_t now_ns(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Return a CPU timestamp counter, 0 where there is none
+static uint64_t cycles(){
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double seconds_of(struct timeval time){
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+/*
+ * time runs the command given by its arguments, and prints out to stderr
+ * the wall and CPU time, page faults and cycles it took. It returns what
+ * the command returns.
+ */
+int cmd_time(int argc, char *argv[]){
+    if (argc < 2){
+        fprintf(stderr, "%s: must accept a command\n", argv[0]);
+        return 1;
+    }
+    struct commandEntry *command = find_command(argv[1]);
+    if (command == NULL){
+        fprintf(stderr, "%s: %s: command not found\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start_cycles = cycles();
+    uint64_t start = now_ns();
+    int status = command->functionp(argc - 1, argv + 1);
+    uint64_t end = now_ns();
+    uint64_t end_cycles = cycles();
+    getrusage(RUSAGE_SELF, &after);
+
+    fprintf(stderr, "real    %.9f s\n", (end - start) / 1e9);
+    fprintf(stderr, "user    %.6f s\n", seconds_of(after.ru_utime) - seconds_of(before.ru_utime));
+    fprintf(stderr, "sys     %.6f s\n", seconds_of(after.ru_stime) - seconds_of(before.ru_stime));
+    fprintf(stderr, "faults  %ld minor, %ld major\n", after.ru_minflt - before.ru_minflt,
+            after.ru_majflt - before.ru_majflt);
+    if (end_cycles != 0)
+        fprintf(stderr, "cycles  %lu\n", end_cycles - start_cycles);
+    return status;
+}
+
+static int compare_latencies(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * repeat runs the command given by its second and later arguments as many
+ * times as the first says, timing every run, and prints out to stderr the
+ * min, median, p99 and max latencies. The count can be specified in
+ * decimal, octal, or hexadecimal format. It returns 1 if any run failed.
+ */
+int cmd_repeat(int argc, char *argv[]){
+    if (argc < 3){
+        fprintf(stderr, "%s: must accept a count and a command\n", argv[0]);
+        return 1;
+    }
+    long runs;
+    if (multi_strtol(argv[1], &runs))
+        return 1;
+    if (runs <= 0){
+        fprintf(stderr, "%s: count must be > 0\n", argv[0]);
+        return 1;
+    }
+    struct commandEntry *command = find_command(argv[2]);
+    if (command == NULL){
+        fprintf(stderr, "%s: %s: command not found\n", argv[0], argv[2]);
+        return 1;
+    }
+    uint64_t *latencies = (uint64_t *)malloc(runs * sizeof(uint64_t));
+    if (latencies == NULL){
+        fprintf(stderr, "%s: cannot keep %ld latencies\n", argv[0], runs);
+        return 1;
+    }
+
+    long failed = 0;
+    uint64_t total = 0;
+    for (long i = 0; i < runs; i++){
+        uint64_t start = now_ns();
+        failed += command->functionp(argc - 2, argv + 2) != 0;
+        latencies[i] = now_ns() - start;
+        total += latencies[i];
+    }
+
+    qsort(latencies, runs, sizeof(uint64_t), compare_latencies);
+    fprintf(stderr, "runs    %ld, %ld failed\n", runs, failed);
+    fprintf(stderr, "ns      min %lu, median %lu, p99 %lu, max %lu, mean %lu\n",
+            latencies[0], latencies[runs / 2], latencies[runs * 99 / 100],
+            latencies[runs - 1], total / runs);
+    free(latencies);
+    return failed != 0;
+}
+
 struct commandEntry commands[] = {{"date", cmd_date},
                                   {"echo", cmd_echo},
                                   {"exit", cmd_exit},
@@ -362,111 +897,222 @@ struct commandEntry commands[] = {{"date", cmd_date},
                                   {"free", cmd_free},
                                   {"memorymap", cmd_memorymap},
                                   {"memset", cmd_memset},
-                                  {"memchk", cmd_memchk}
+                                  {"memchk", cmd_memchk},
+                                  {"pool", cmd_pool},
+                                  {"memstats", cmd_memstats},
+                                  {"time", cmd_time},
+                                  {"repeat", cmd_repeat}
 };
 
+// commands[] indexed by the hash of their names, NULL in empty slots
+struct commandEntry *command_table[COMMAND_SLOTS];
+
+// FNV-1a hash of a command name
+static uint32_t hash_name(const char *name){
+    uint32_t hash = 2166136261u;
+    while (*name != '\0'){
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Fill command_table with every entry in commands[]
+void index_commands(){
+    for (int i = 0; i < COMMAND_NUM; i++){
+        uint32_t slot = hash_name(commands[i].name) & (COMMAND_SLOTS - 1);
+        while (command_table[slot] != NULL)
+            slot = (slot + 1) & (COMMAND_SLOTS - 1);
+        command_table[slot] = &commands[i];
+    }
+}
+
+// Return the command called name, NULL if there is none
+struct commandEntry *find_command(const char *name){
+    uint32_t slot = hash_name(name) & (COMMAND_SLOTS - 1);
+    for (; command_table[slot] != NULL; slot = (slot + 1) & (COMMAND_SLOTS - 1)){
+        if (!strcmp(name, command_table[slot]->name))
+            return command_table[slot];
+    }
+    return NULL;
+}
+
+// Double the slots of fields, return 0 if succeed, return 1 if fail
+int grow_fields(){
+    size_t slots = field_slots ? 2 * field_slots : 64;
+    char **grown = (char **)realloc(fields, slots * sizeof(char *));
+    if (grown == NULL){
+        fprintf(stderr, "Error: Memory allocation for argv failed.\n");
+        return 1;
+    }
+    fields = grown;
+    field_slots = slots;
+    return 0;
+}
+
 /*
- * Parse a line into space separated fields.
+ * Parse a line into space separated fields, in place: every field is
+ * ended by overwriting the space after it.
  * Store the count of fields into global variable argc.
- * Store the fields into argv.
+ * Store the fields into argv, which points at fields.
  * Return 0 if succeed, return 1 if fail.
  */
 int parse_line(char* line){
-
-    // Get argc
-    if (line[0] != ' ' && line[0] != '\0')
-        argc++;
-        
-    for (int i = 1; line[i] != '\0'; i++){
-        if (line[i - 1] == ' ' && line[i] != ' ')
-            argc++;
-    }
-
-    argv = (char **)malloc((argc + 1) * sizeof(char *));
-    if (argv == NULL){
-	fprintf(stderr, "Error: Memory allocation for argv failed.\n");
-	return 1;
-    }
-    
-    // Get argv
     argc = 0;
-    int i = 0;
-    int j = 0;
-        
-    if (line[0] != ' ' && line[0] != '\0')
-        argc++;
-
-    while (line[i] != '\0'){
-        i++;
-        // Begin of a field
-        if (line[i] != '\0' && line[i - 1] == ' ' && line[i] != ' '){
-            argc++;
-            j = i;
-        }
-        // End of a field
-        // Including the edge case of end of line
-        else if ((line[i] == '\0' || (line[i] == ' ')) && (line[i - 1] != ' ')){
-            argv[argc - 1] = (char *)malloc((i - j) * sizeof(char));
-	    if (argv[argc - 1] == NULL){
-		fprintf(stderr, "Error: Memory allocation for argv[%d] failed.\n", argc - 1);
-		return 1;
-	    }
-            strncpy(argv[argc - 1], line + j, i - j);
-            argv[argc - 1][i - j] = '\0';
+    for (char *next = line; *next != '\0'; next++){
+        if (*next == ' ')
+            *next = '\0';
+        else if (next == line || next[-1] == '\0'){
+            // Keep a slot for the field and the closing NULL
+            if (argc + 2 > field_slots && grow_fields())
+                return 1;
+            fields[argc++] = next;
         }
     }
-
+    if (field_slots == 0 && grow_fields())
+        return 1;
+    argv = fields;
     argv[argc] = NULL;
     return 0;
 }
 
-int main(){
-    char line[LINE_SIZE + 1];
+// Input of the shell, read a block at a time
+struct input {
+    int fd;
+    char *buffer; // one byte longer than capacity, for the NUL of a last line
+    size_t capacity;
+    size_t begin; // of the bytes read but not yet handed out
+    size_t end;
+    int eof;
+};
+
+/*
+ * Return the next line of input, without its newline, or NULL at the end
+ * of the input. Lines can be of any length. The line stays valid until
+ * the next call.
+ */
+char *read_line(struct input *in){
+    while (1){
+        char *line = in->buffer + in->begin;
+        char *newline = memchr(line, '\n', in->end - in->begin);
+        if (newline != NULL){
+            *newline = '\0';
+            in->begin = newline + 1 - in->buffer;
+            return line;
+        }
+        if (in->eof){
+            if (in->begin == in->end)
+                return NULL;
+            in->buffer[in->end] = '\0';
+            in->begin = in->end;
+            return line;
+        }
+
+        // Move the partial line to the front, and make room after it
+        memmove(in->buffer, line, in->end - in->begin);
+        in->end -= in->begin;
+        in->begin = 0;
+        if (in->capacity - in->end < READ_SIZE){
+            char *grown = (char *)realloc(in->buffer, 2 * in->capacity + 1);
+            if (grown == NULL){
+                fprintf(stderr, "Error: Memory allocation for the line failed.\n");
+                return NULL;
+            }
+            in->buffer = grown;
+            in->capacity *= 2;
+        }
 
-    // Initialize 128MB memory pool and currentPCB.
+        ssize_t got = read(in->fd, in->buffer + in->end, in->capacity - in->end);
+        if (got > 0)
+            in->end += got;
+        else if (got == 0 || errno != EINTR)
+            in->eof = 1;
+    }
+}
+
+/*
+ * The shell reads commands from the file given as its argument, or from
+ * stdin. It runs interactively, with a prompt before each line, when the
+ * input is a terminal; otherwise it runs in batch mode, with no prompts
+ * and its output buffered, to take scripts and piped commands at full
+ * speed. -i or -b choose the mode. The shell exits at the end of input.
+ */
+int main(int count, char *args[]){
+    int batch = 0;
+    int interactive = 0;
+    char *path = NULL;
+    for (int i = 1; i < count; i++){
+        if (!strcmp(args[i], "-b")){
+            batch = 1;
+            interactive = 0;
+        }
+        else if (!strcmp(args[i], "-i")){
+            interactive = 1;
+            batch = 0;
+        }
+        else if (path == NULL && args[i][0] != '-')
+            path = args[i];
+        else{
+            fprintf(stderr, "usage: %s [-b | -i] [file]\n", args[0]);
+            return 1;
+        }
+    }
+
+    struct input in = {STDIN_FILENO, (char *)malloc(2 * READ_SIZE + 1), 2 * READ_SIZE, 0, 0, 0};
+    if (in.buffer == NULL){
+        fprintf(stderr, "Error: Memory allocation for the line failed.\n");
+        return 1;
+    }
+    if (path != NULL){
+        in.fd = open(path, O_RDONLY);
+        if (in.fd < 0){
+            fprintf(stderr, "shell: cannot open %s\n", path);
+            return 1;
+        }
+    }
+    // without -b or -i, the input decides
+    if (!batch && !interactive)
+        batch = !isatty(in.fd);
+    if (batch)
+        setvbuf(stdout, NULL, _IOFBF, READ_SIZE);
+
+    // Initialize the memory pool and currentPCB.
     myInitializeMemory();
+    index_commands();
 
     while(1){
-        fputs("$ ", stdout);
-        
-        // Get a line of input
-        int i = 0;
-        char c;
-        while (i <= LINE_SIZE && (c = fgetc(stdin)) != EOF && c != '\n') {
-            line[i] = c;
-            i++;
+        if (!batch){
+            fputs("$ ", stdout);
+            fflush(stdout);
         }
-        line[i] = '\0';
+
+        // Get a line of input
+        char *line = read_line(&in);
+        if (line == NULL)
+            break;
 
         // Parse that line
         if (parse_line(line)){
-	    fprintf(stderr, "Error: Line parse failed.\n");
-	    return 1;
-	}
+            fprintf(stderr, "Error: Line parse failed.\n");
+            return 1;
+        }
 
         // If there is input
         if (argc){
         // Execute the corresponding command
-            int i = 0;
-	    while (i < COMMAND_NUM){
-                if (!strcmp(argv[0], commands[i].name)){
-                    commands[i].functionp(argc, argv);
-                    break;
-                }
-		i++;
+            struct commandEntry *command = find_command(argv[0]);
+            if (command != NULL){
+                command->functionp(argc, argv);
             }
 
             // If the command is not found
-            if (i == COMMAND_NUM){
+            else{
                 fprintf(stderr, "shell: %s: command not found\n", argv[0]);
             }
-
-            // Free memory
-            for (int i = 0; i < argc; i++){
-                free(argv[i]);
-            }
-            free(argv);
-            argc = 0;
         }
     }
+
+    if (!batch)
+        fputs("\n", stdout);
+    myTeardownMemory();
+    return 0;
 }
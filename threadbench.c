@@ -0,0 +1,107 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libmem.h"
+
+#define WINDOW 1024 // live regions kept by each thread
+#define EXCHANGE 256 // slots for passing regions between threads
+#define HANDOFF 16 // every 16th region is freed by another thread
+#define SIZE_MAX_SMALL 256 // regions are 1 to 256 bytes
+
+/*
+ * threadbench measures myMalloc/myFree throughput in multithreaded mode
+ * with 1 to N threads. Every thread keeps a window of live regions and
+ * replaces a random one per step. Every HANDOFF-th region is swapped into
+ * a shared exchange array instead, so the region that comes out of it
+ * was usually allocated by another thread and takes the remote free path.
+ *
+ * Usage: threadbench [max_threads] [steps_per_thread]
+ */
+
+long steps_per_thread = 1000000;
+_Atomic(void *) exchange[EXCHANGE];
+
+// xorshift random number generator, one state per thread
+static uint64_t next_random(uint64_t *state){
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+void *worker(void *arg){
+    uint64_t state = (uintptr_t)arg * 0x9E3779B97F4A7C15ULL + 1;
+    void *window[WINDOW];
+    memset(window, 0, sizeof(window));
+
+    for (long step = 0; step < steps_per_thread; step++){
+        int slot = next_random(&state) % WINDOW;
+        myFree(window[slot]);
+        window[slot] = myMalloc(1 + next_random(&state) % SIZE_MAX_SMALL);
+
+        if (step % HANDOFF == 0){
+            int other = next_random(&state) % EXCHANGE;
+            void *old = atomic_exchange(&exchange[other], window[slot]);
+            window[slot] = old;
+        }
+    }
+
+    for (int slot = 0; slot < WINDOW; slot++){
+        myFree(window[slot]);
+    }
+    return NULL;
+}
+
+// run the workload on threads threads, return the elapsed seconds
+double run(int threads){
+    pthread_t tids[threads];
+    struct timespec begin, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < threads; i++){
+        pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < threads; i++){
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < EXCHANGE; i++){
+        myFree(atomic_exchange(&exchange[i], NULL));
+    }
+    return (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]){
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1){
+        max_threads = atoi(argv[1]);
+    }
+    if (argc > 2){
+        steps_per_thread = atol(argv[2]);
+    }
+    if (max_threads < 1 || steps_per_thread < 1){
+        fprintf(stderr, "Usage: %s [max_threads] [steps_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    if (myInitializeMemory() || myEnableMultithreading()){
+        return 1;
+    }
+
+    fputs(" threads   malloc+free/s   per thread   speedup\n", stdout);
+    fputs("-----------------------------------------------\n", stdout);
+    double base = 0;
+    for (int threads = 1; threads <= max_threads; threads++){
+        double seconds = run(threads);
+        double rate = threads * steps_per_thread / seconds;
+        if (threads == 1){
+            base = rate;
+        }
+        fprintf(stdout, " %7d   %13.0f   %10.0f   %6.2fx\n",
+                threads, rate, rate / threads, rate / base);
+    }
+    return 0;
+}